@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mem {
+
+/// \brief The allocation profile of one type (or size-class) recorded in a
+/// representative run, e.g. from SubtypeAllocatorDriver::getStatistics() or
+/// from a ProfileRecorder.
+struct SizeClassProfile {
+  std::string name;
+  size_t objectSize;
+  /// The maximum number of objects of this type that were alive at once
+  size_t peakObjects;
+};
+
+/// \brief Weighs the costs of the two things a block size trades off.
+struct BlockSizeCostModel {
+  /// The cost of one actual memory allocation, in bytes of wasted memory that
+  /// it is worth
+  double costPerBlockAllocation = 4096;
+  /// The cost of one byte that is allocated, but never used
+  double costPerWastedByte = 1;
+};
+
+/// \brief The result of simulating one size-class with a candidate block size.
+struct BlockSizeRecommendation {
+  std::string name;
+  /// The number of objects per block that minimizes the cost
+  size_t blockSize;
+  /// The number of objects to preallocate (e.g. as RefcFactory initial
+  /// capacity). Reserving the peak needs one allocation and wastes nothing.
+  size_t reserve;
+  size_t numBlocks;
+  size_t wastedBytes;
+  double cost;
+};
+
+/// \brief Records the live-object count of a type from an allocation trace.
+class ProfileRecorder {
+  size_t live = 0;
+  size_t peak = 0;
+
+public:
+  void allocated(size_t N = 1) noexcept {
+    live += N;
+    if (live > peak)
+      peak = live;
+  }
+  void deallocated(size_t N = 1) noexcept { live -= N; }
+
+  SizeClassProfile profile(std::string Name, size_t ObjectSize) const {
+    return {std::move(Name), ObjectSize, peak};
+  }
+};
+
+/// \brief Converts the statistics of a SubtypeAllocatorDriver (see
+/// SubtypeAllocatorDriver::getStatistics()) into profiles. Since the free-list
+/// is always used first, the number of used chunks is the peak number of live
+/// objects. The size-classes are named "Id<n>" after their UserAllocatorId.
+template <typename StatisticsT>
+std::vector<SizeClassProfile>
+profileFromStatistics(const std::vector<StatisticsT> &Stats) {
+  std::vector<SizeClassProfile> ret;
+  ret.reserve(Stats.size());
+  for (size_t id = 0; id < Stats.size(); ++id)
+    ret.push_back(
+        {"Id" + std::to_string(id), Stats[id].objectSize, Stats[id].numUsed});
+  return ret;
+}
+
+/// \brief Simulates a pool that allocates blocks of \p BlockSize objects for
+/// the objects in \p Profile, without reserving memory upfront.
+inline BlockSizeRecommendation
+simulateBlockSize(const SizeClassProfile &Profile, size_t BlockSize,
+                  const BlockSizeCostModel &Model = {}) {
+  // Deallocated objects are always reused, so the pool grows up to the peak
+  const size_t numBlocks = (Profile.peakObjects + BlockSize - 1) / BlockSize;
+  const size_t wastedBytes =
+      (numBlocks * BlockSize - Profile.peakObjects) * Profile.objectSize;
+  const double cost = numBlocks * Model.costPerBlockAllocation +
+                      wastedBytes * Model.costPerWastedByte;
+  return {Profile.name, BlockSize, Profile.peakObjects, numBlocks, wastedBytes,
+          cost};
+}
+
+/// \brief Returns the default candidate block sizes: powers of two from 16
+/// to 65536 objects
+inline std::vector<size_t> defaultBlockSizeCandidates() {
+  std::vector<size_t> ret;
+  for (size_t bs = 16; bs <= 65536; bs *= 2)
+    ret.push_back(bs);
+  return ret;
+}
+
+/// \brief Chooses the cheapest of the \p Candidates block sizes for each
+/// profiled type separately, e.g. for PoolAllocator's \c BlockSize.
+inline std::vector<BlockSizeRecommendation>
+recommendBlockSizes(const std::vector<SizeClassProfile> &Profiles,
+                    const std::vector<size_t> &Candidates =
+                        defaultBlockSizeCandidates(),
+                    const BlockSizeCostModel &Model = {}) {
+  std::vector<BlockSizeRecommendation> ret;
+  ret.reserve(Profiles.size());
+
+  for (auto &profile : Profiles) {
+    BlockSizeRecommendation best{};
+    best.cost = std::numeric_limits<double>::infinity();
+    for (auto bs : Candidates) {
+      auto rec = simulateBlockSize(profile, bs, Model);
+      if (rec.cost < best.cost)
+        best = std::move(rec);
+    }
+    ret.push_back(std::move(best));
+  }
+
+  return ret;
+}
+
+/// \brief Chooses the cheapest of the \p Candidates block sizes for all
+/// profiled types together, e.g. for the \c AllocationBlockSize of a
+/// SubtypeAllocatorDriver or RefcFactory that is shared by all of them.
+inline size_t
+recommendSharedBlockSize(const std::vector<SizeClassProfile> &Profiles,
+                         const std::vector<size_t> &Candidates =
+                             defaultBlockSizeCandidates(),
+                         const BlockSizeCostModel &Model = {}) {
+  size_t best = 0;
+  double bestCost = std::numeric_limits<double>::infinity();
+  for (auto bs : Candidates) {
+    double cost = 0;
+    for (auto &profile : Profiles)
+      cost += simulateBlockSize(profile, bs, Model).cost;
+    if (cost < bestCost) {
+      bestCost = cost;
+      best = bs;
+    }
+  }
+  return best;
+}
+
+/// \brief Writes \p Profiles as CSV lines "name,objectSize,peakObjects".
+inline void writeProfile(std::ostream &OS,
+                         const std::vector<SizeClassProfile> &Profiles) {
+  for (auto &profile : Profiles)
+    OS << profile.name << ',' << profile.objectSize << ','
+       << profile.peakObjects << '\n';
+}
+
+namespace detail {
+/// Parses all of \p Field as a decimal number.
+inline bool parseCount(const std::string &Field, size_t &Out) {
+  const auto *end = Field.data() + Field.size();
+  auto [ptr, ec] = std::from_chars(Field.data(), end, Out);
+  return ec == std::errc() && ptr == end;
+}
+} // namespace detail
+
+/// \brief Reads profiles written by writeProfile(). Skips empty lines and
+/// lines starting with '#'.
+///
+/// \throws std::invalid_argument naming the line number and content of the
+/// first malformed line
+inline std::vector<SizeClassProfile> readProfile(std::istream &IS) {
+  std::vector<SizeClassProfile> ret;
+  std::string line;
+  for (size_t lineNo = 1; std::getline(IS, line); ++lineNo) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    SizeClassProfile profile;
+    std::string size, peak;
+    if (!std::getline(fields, profile.name, ',') ||
+        !std::getline(fields, size, ',') || !std::getline(fields, peak) ||
+        !detail::parseCount(size, profile.objectSize) ||
+        !detail::parseCount(peak, profile.peakObjects))
+      throw std::invalid_argument("Malformed profile line " +
+                                  std::to_string(lineNo) + ": " + line);
+    ret.push_back(std::move(profile));
+  }
+  return ret;
+}
+
+/// \brief Turns \p Name into a C++ identifier by replacing all other
+/// characters with '_', e.g. "std::string" becomes "std__string".
+inline std::string toIdentifier(const std::string &Name) {
+  std::string ret = Name;
+  for (auto &c : ret) {
+    if (!std::isalnum(static_cast<unsigned char>(c)))
+      c = '_';
+  }
+  if (ret.empty() || std::isdigit(static_cast<unsigned char>(ret[0])))
+    ret.insert(0, "SizeClass");
+  return ret;
+}
+
+/// \brief Writes a header defining a constexpr block size and reserve count
+/// for each recommendation, as well as \p SharedBlockSize (if not 0), inside
+/// \p Namespace. The constants are named after toIdentifier() of the
+/// recommendation's name.
+inline void
+writeRecommendationHeader(std::ostream &OS,
+                          const std::vector<BlockSizeRecommendation> &Recs,
+                          size_t SharedBlockSize = 0,
+                          const std::string &Namespace = "mem_tuning") {
+  OS << "#pragma once\n\n"
+     << "// Generated by the block-size advisor. Do not edit.\n\n"
+     << "#include <cstddef>\n\n"
+     << "namespace " << Namespace << " {\n";
+  if (SharedBlockSize)
+    OS << "constexpr size_t AllocationBlockSize = " << SharedBlockSize
+       << ";\n";
+  for (auto &rec : Recs) {
+    const auto name = toIdentifier(rec.name);
+    OS << "constexpr size_t " << name << "BlockSize = " << rec.blockSize
+       << ";\n"
+       << "constexpr size_t " << name << "Reserve = " << rec.reserve << ";\n";
+  }
+  OS << "} // namespace " << Namespace << '\n';
+}
+
+} // namespace mem
\ No newline at end of file
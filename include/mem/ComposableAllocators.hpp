@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <type_traits>
+
+#include "mem/PoolAllocator.hpp"
+#include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+
+namespace mem {
+
+// Building blocks for assembling allocation strategies from parts. All of them
+// share the same untyped interface:
+//
+//   void *allocate(size_t Size, size_t Align);
+//   void deallocate(void *Ptr, size_t Size, size_t Align);
+//   bool owns(const void *Ptr) const;
+//
+// allocate() returns nullptr, if the allocator does not serve the requested
+// size or alignment, so that a combinator can try another one. deallocate()
+// must be called with the same Size and Align that have been passed to
+// allocate().
+
+/// \brief Allocates from the global heap with \c malloc (or \c aligned_alloc
+/// for over-aligned requests). Accepts every request and claims to own every
+/// pointer, so it must be the last alternative of a composition.
+class Mallocator {
+public:
+  void *allocate(size_t Size, size_t Align) noexcept {
+    if (Align <= alignof(std::max_align_t))
+      return std::malloc(Size);
+    return std::aligned_alloc(Align, (Size + Align - 1) & ~(Align - 1));
+  }
+
+  void deallocate(void *Ptr, size_t, size_t) noexcept {
+    std::free(Ptr);
+  }
+
+  bool owns(const void *) const noexcept { return true; }
+};
+
+/// \brief A PoolAllocator for chunks of \p ChunkSize bytes. Serves all
+/// requests of up to \p ChunkSize bytes with an alignment of up to \p
+/// ChunkAlignment.
+///
+/// \tparam BlockSize The number of chunks that should be allocated at once
+template <size_t ChunkSize, size_t ChunkAlignment = alignof(std::max_align_t),
+          unsigned BlockSize = 1024>
+class PoolSlab {
+  using chunk_t = std::aligned_storage_t<ChunkSize, ChunkAlignment>;
+
+  PoolAllocator<chunk_t, true, BlockSize> Pool;
+
+public:
+  void *allocate(size_t Size, size_t Align) {
+    if (Size > ChunkSize || Align > ChunkAlignment)
+      return nullptr;
+    return Pool.allocate(1);
+  }
+
+  void deallocate(void *Ptr, size_t, size_t) {
+    Pool.deallocate(static_cast<chunk_t *>(Ptr), 1);
+  }
+
+  bool owns(const void *Ptr) const noexcept { return Pool.owns(Ptr); }
+};
+
+/// \brief A SubtypeAllocatorDriver that serves requests of any size and
+/// alignment from a separate size-class per normalized size and alignment.
+/// Intended for a limited range of sizes, e.g. inside a Segregator or
+/// Bucketizer, since looking up the size-class takes time linear in the
+/// number of size-classes.
+///
+/// \tparam AllocationBlockSize The number of objects of one size-class that
+/// should be allocated at once
+template <size_t AllocationBlockSize = 1024> class DriverAllocator {
+  SubtypeAllocatorDriver<AllocationBlockSize> Driver;
+
+public:
+  void *allocate(size_t Size, size_t Align) {
+    return Driver.allocate(Driver.getId(Size, Align));
+  }
+
+  void deallocate(void *Ptr, size_t Size, size_t Align) {
+    Driver.deallocate(Ptr, Driver.getId(Size, Align));
+  }
+
+  bool owns(const void *Ptr) const noexcept { return Driver.owns(Ptr); }
+
+  /// Provides access to the underlying SubtypeAllocatorDriver
+  SubtypeAllocatorDriver<AllocationBlockSize> &getDriver() noexcept {
+    return Driver;
+  }
+};
+
+/// \brief Serves requests of up to \p Threshold bytes with \p Small and all
+/// larger ones with \p Large.
+template <size_t Threshold, typename Small, typename Large> class Segregator {
+  Small small;
+  Large large;
+
+public:
+  void *allocate(size_t Size, size_t Align) {
+    return Size <= Threshold ? small.allocate(Size, Align)
+                             : large.allocate(Size, Align);
+  }
+
+  void deallocate(void *Ptr, size_t Size, size_t Align) {
+    if (Size <= Threshold)
+      small.deallocate(Ptr, Size, Align);
+    else
+      large.deallocate(Ptr, Size, Align);
+  }
+
+  bool owns(const void *Ptr) const noexcept {
+    return small.owns(Ptr) || large.owns(Ptr);
+  }
+
+  Small &getSmall() noexcept { return small; }
+  Large &getLarge() noexcept { return large; }
+};
+
+/// \brief Tries to serve requests with \p Primary and falls back to \p
+/// Secondary, if \p Primary rejects them. Uses \p Primary's owns() to route
+/// deallocations.
+template <typename Primary, typename Secondary> class FallbackAllocator {
+  Primary primary;
+  Secondary secondary;
+
+public:
+  void *allocate(size_t Size, size_t Align) {
+    if (auto *ret = primary.allocate(Size, Align))
+      return ret;
+    return secondary.allocate(Size, Align);
+  }
+
+  void deallocate(void *Ptr, size_t Size, size_t Align) {
+    if (primary.owns(Ptr))
+      primary.deallocate(Ptr, Size, Align);
+    else
+      secondary.deallocate(Ptr, Size, Align);
+  }
+
+  bool owns(const void *Ptr) const noexcept {
+    return primary.owns(Ptr) || secondary.owns(Ptr);
+  }
+
+  Primary &getPrimary() noexcept { return primary; }
+  Secondary &getSecondary() noexcept { return secondary; }
+};
+
+/// \brief Splits the sizes in (\p MinSize, \p MaxSize] into buckets of \p
+/// StepSize bytes each and serves every bucket with a separate instance of \p
+/// Allocator. Rejects all other sizes.
+template <typename Allocator, size_t MinSize, size_t MaxSize, size_t StepSize>
+class Bucketizer {
+  static_assert(MinSize < MaxSize && StepSize != 0 &&
+                    (MaxSize - MinSize) % StepSize == 0,
+                "The size-range must be divisible into buckets of StepSize");
+
+public:
+  static constexpr size_t NumBuckets = (MaxSize - MinSize) / StepSize;
+
+private:
+  std::array<Allocator, NumBuckets> buckets;
+
+  static size_t bucketIndex(size_t Size) noexcept {
+    return (Size - MinSize - 1) / StepSize;
+  }
+
+public:
+  void *allocate(size_t Size, size_t Align) {
+    if (Size <= MinSize || Size > MaxSize)
+      return nullptr;
+    return buckets[bucketIndex(Size)].allocate(Size, Align);
+  }
+
+  void deallocate(void *Ptr, size_t Size, size_t Align) {
+    buckets[bucketIndex(Size)].deallocate(Ptr, Size, Align);
+  }
+
+  bool owns(const void *Ptr) const noexcept {
+    for (auto &bucket : buckets) {
+      if (bucket.owns(Ptr))
+        return true;
+    }
+    return false;
+  }
+
+  /// Provides access to the allocator that serves requests of \p Size bytes
+  Allocator &getBucket(size_t Size) noexcept {
+    return buckets[bucketIndex(Size)];
+  }
+};
+} // namespace mem
\ No newline at end of file
@@ -1,8 +1,13 @@
 #pragma once
+#include <cassert>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
+
+#include "mem/Probes.hpp"
 
 namespace mem {
 
@@ -23,6 +28,9 @@ namespace mem {
 template <typename T, bool UseFreeList = true, unsigned BlockSize = 1024>
 class PoolAllocator {
   static_assert(BlockSize != 0, "The BlockSize must not be 0");
+  /// Describes a block of objects. The descriptors are kept in a side table
+  /// (MemoryPool::pool), such that the objects start right at the beginning of
+  /// the allocated memory and no block is padded for over-aligned types.
   struct Block {
     union DataField {
       DataField *nextFree;
@@ -31,30 +39,37 @@ class PoolAllocator {
 
     using value_type =
         std::aligned_storage_t<sizeof(DataField), alignof(DataField)>;
-    Block *next;
-    value_type data[0];
-
-    static Block *create(Block *nxt, unsigned n) {
-      // sizeof(Block) already contains the padding between Block::next and
-      // Block::data
-      auto ret = reinterpret_cast<Block *>(::new (std::align_val_t{
-          alignof(Block)}) uint8_t[sizeof(Block) + (n * sizeof(value_type))]);
-      ret->next = nxt;
-      return ret;
+    value_type *data;
+    /// The number of objects this block has been created for
+    unsigned numObjects;
+
+    static Block create(unsigned n) {
+      auto *data = reinterpret_cast<value_type *>(::new (std::align_val_t{
+          alignof(value_type)}) uint8_t[n * sizeof(value_type)]);
+      MEM_PROBE3(pool_block_create, data, n, sizeof(value_type));
+      return {data, n};
+    }
+
+    void destroy() noexcept {
+      MEM_PROBE1(pool_block_destroy, data);
+      ::operator delete[](reinterpret_cast<uint8_t *>(data),
+                          std::align_val_t{alignof(value_type)});
     }
   };
 
   template <bool FL> struct MemoryPool;
   template <> struct MemoryPool<true> {
-    Block *pool;
+    /// All blocks; the last one is filled currently
+    std::vector<Block> pool;
     typename Block::DataField *freeList;
 
-    MemoryPool() noexcept : pool(nullptr), freeList(nullptr) {}
+    MemoryPool() noexcept : freeList(nullptr) {}
     MemoryPool(std::nullptr_t) noexcept : MemoryPool() {}
   };
   template <> struct MemoryPool<false> {
-    Block *pool;
-    MemoryPool() noexcept : pool(nullptr) {}
+    /// All blocks; the last one is filled currently
+    std::vector<Block> pool;
+    MemoryPool() noexcept {}
     MemoryPool(std::nullptr_t) noexcept : MemoryPool() {}
   };
 
@@ -63,6 +78,19 @@ class PoolAllocator {
   unsigned currBlockSize;
   unsigned index;
 
+  /// Appends a new block of \p n objects to the side table and returns its
+  /// data
+  typename Block::value_type *addBlock(unsigned n) {
+    auto blck = Block::create(n);
+    try {
+      mpool.pool.push_back(blck);
+    } catch (...) {
+      blck.destroy();
+      throw;
+    }
+    return blck.data;
+  }
+
 public:
   PoolAllocator(unsigned reserved = BlockSize) noexcept
       : mpool(), index(reserved),
@@ -77,7 +105,7 @@ public:
       : PoolAllocator(other.minCapacity()) {}
 
   PoolAllocator(PoolAllocator &&other) noexcept
-      : mpool(other.mpool), index(other.index),
+      : mpool(std::move(other.mpool)), index(other.index),
         currBlockSize(other.currBlockSize) {
     other.mpool = nullptr;
   }
@@ -91,14 +119,8 @@ public:
 
   ~PoolAllocator() {
     // The data inside the blocks is assumed to be already destroyed.
-    for (auto p = mpool.pool; p;) {
-      auto nxt = p->next;
-
-      ::operator delete[](reinterpret_cast<uint8_t *>(p),
-                          std::align_val_t{alignof(Block)});
-      //::delete[] reinterpret_cast<uint8_t *>(p);
-      p = nxt;
-    }
+    for (auto &blck : mpool.pool)
+      blck.destroy();
 
     mpool = nullptr;
   }
@@ -132,25 +154,17 @@ public:
     }
 
     if (index == currBlockSize) {
-
-      Block *nwPl;
-      if (mpool.pool) {
-        // std::cout << "> Allocate " << BlockSize << " elements" << std::endl;
-        nwPl = Block::create(mpool.pool, BlockSize);
-
-        if (currBlockSize != BlockSize)
-          currBlockSize = BlockSize;
-      } else {
-        // std::cout << "> Allocate " << currBlockSize << " elements" <<
-        // std::endl;
-        nwPl = Block::create(mpool.pool, currBlockSize);
-      }
-      mpool.pool = nwPl;
+      // The first block may have been reserved with a different size
+      if (!mpool.pool.empty() && currBlockSize != BlockSize)
+        currBlockSize = BlockSize;
+      // std::cout << "> Allocate " << currBlockSize << " elements" <<
+      // std::endl;
+      auto *nwPl = addBlock(currBlockSize);
       index = 1;
-      return reinterpret_cast<pointer>(&nwPl->data[0]);
+      return reinterpret_cast<pointer>(&nwPl[0]);
     }
 
-    return reinterpret_cast<pointer>(&mpool.pool->data[index++]);
+    return reinterpret_cast<pointer>(&mpool.pool.back().data[index++]);
   }
 
   void deallocate(pointer ptr, size_t n) {
@@ -177,6 +191,58 @@ public:
     ptr->T::~T();
   }
 
+  /// \brief Makes sure that the next \p n allocations of single objects do
+  /// not allocate memory.
+  ///
+  /// If no object has been allocated yet, this just enlarges the first block,
+  /// such that the reservation is kept when a container copies (rebinds) this
+  /// allocator. Otherwise, allocates a block that is large enough for the
+  /// objects that do not fit into the current block any more. When using a
+  /// free-list, the rest of the current block stays usable.
+  ///
+  /// \throws std::length_error if \p n exceeds the largest number of objects
+  /// per block (\c std::numeric_limits<unsigned>::max())
+  void reserve(size_t n) {
+    if (n > std::numeric_limits<unsigned>::max())
+      throw std::length_error("PoolAllocator::reserve: too many objects");
+
+    if (mpool.pool.empty()) {
+      if (n > currBlockSize)
+        index = currBlockSize = static_cast<unsigned>(n);
+      return;
+    }
+
+    const size_t rem = currBlockSize - index;
+    if (rem >= n)
+      return;
+
+    if constexpr (UseFreeList) {
+      // Iterate in reverse order to keep the allocation order
+      for (auto i = currBlockSize; i > index; --i) {
+        auto *fl = reinterpret_cast<typename Block::DataField *>(
+            &mpool.pool.back().data[i - 1]);
+        fl->nextFree = mpool.freeList;
+        mpool.freeList = fl;
+      }
+      n -= rem;
+    }
+
+    addBlock(static_cast<unsigned>(n));
+    currBlockSize = static_cast<unsigned>(n);
+    index = 0;
+  }
+
+  /// \brief Checks whether \p ptr points into one of the blocks of this
+  /// allocator. Takes time linear in the number of blocks.
+  bool owns(const void *ptr) const noexcept {
+    auto p = static_cast<const typename Block::value_type *>(ptr);
+    for (auto &blck : mpool.pool) {
+      if (p >= blck.data && p < blck.data + blck.numObjects)
+        return true;
+    }
+    return false;
+  }
+
   bool operator==(const PoolAllocator &other) const noexcept { return true; }
   bool operator!=(const PoolAllocator &other) const noexcept {
     return !(*this == other);
@@ -185,4 +251,18 @@ public:
   // For internal use only
   unsigned minCapacity() const noexcept { return currBlockSize; }
 };
+
+/// \brief Makes sure that inserting the next \p n elements into the empty
+/// node-based container \p C (e.g. \c std::set or \c std::list) using a
+/// PoolAllocator performs exactly one block allocation.
+///
+/// Containers only hold a private (rebound) copy of their allocator, so this
+/// rebuilds \p C with an allocator that reserves space for \p n nodes.
+template <typename Container> void reserve_nodes(Container &C, size_t n) {
+  assert(C.empty() && "Can only reserve nodes in an empty container");
+
+  auto alloc = C.get_allocator();
+  alloc.reserve(n);
+  C = Container(std::move(C), alloc);
+}
 } // namespace mem
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+namespace mem {
+
+/// \brief Runtime parameters of a SubtypeAllocatorDriver (and the factories
+/// based on it), e.g. for tuning a deployment without recompiling. Pass it to
+/// the driver's (or RefcFactory's) constructor; drivers that are constructed
+/// without one use the compile-time AllocationBlockSize and the defaults below.
+struct PoolConfig {
+  // Not an aggregate, such that braced lists still select other constructors
+  // of the classes that accept a PoolConfig
+  explicit PoolConfig() noexcept = default;
+
+  /// The number of objects of the first block of each size-class. \c 0 selects
+  /// the AllocationBlockSize template argument of the driver.
+  size_t blockSize = 0;
+  /// Each further block of a size-class holds this many times the objects of
+  /// the previous one, up to maxBlockBytes. \c 1 keeps the block size constant.
+  size_t growthFactor = 1;
+  /// Limits the number of objects per block, such that a block does not exceed
+  /// this number of bytes, unless it only holds a single object
+  size_t maxBlockBytes = size_t(1) << 20;
+  /// Objects of at least this size are allocated one by one instead of in
+  /// blocks and are returned to the system on deallocation
+  size_t directThreshold = size_t(256) << 10;
+  /// If not \c 0, the blocks of all size-classes with fundamental alignment
+  /// have exactly this number of bytes, such that blocks whose objects have
+  /// all been freed can be moved to other size-classes, see
+  /// SubtypeAllocatorDriver::reclaimEmptyBlocks(). Replaces blockSize and
+  /// growthFactor for these size-classes.
+  size_t uniformBlockBytes = 0;
+  /// Round the bytes of every block up to whole pages (or 2 MiB huge pages for
+  /// blocks of at least that size) and align them accordingly, such that the
+  /// last page of a block holds objects instead of padding and large blocks
+  /// can be backed by huge pages
+  bool pageExactBlocks = false;
+  /// Touch every page of a new block immediately, such that the page-faults do
+  /// not occur while handing out its objects
+  bool prefault = false;
+  /// Print the statistics of all size-classes to stderr when the driver is
+  /// destroyed
+  bool printStatistics = false;
+
+  /// \brief Overrides the fields of \p Defaults that are set in the
+  /// environment:
+  /// - MEM_POOL_BLOCK_SIZE: blockSize
+  /// - MEM_POOL_GROWTH_FACTOR: growthFactor
+  /// - MEM_POOL_MAX_BLOCK_BYTES: maxBlockBytes
+  /// - MEM_POOL_DIRECT_THRESHOLD: directThreshold
+  /// - MEM_POOL_UNIFORM_BLOCK_BYTES: uniformBlockBytes
+  /// - MEM_POOL_PAGE_EXACT: pageExactBlocks
+  /// - MEM_POOL_PREFAULT: prefault
+  /// - MEM_POOL_STATS: printStatistics
+  ///
+  /// Numbers that cannot be parsed are ignored. Flags are disabled by "0",
+  /// "false" or "off" and enabled by any other value.
+  static PoolConfig fromEnvironment(PoolConfig Defaults) noexcept {
+    readNumber("MEM_POOL_BLOCK_SIZE", Defaults.blockSize);
+    readNumber("MEM_POOL_GROWTH_FACTOR", Defaults.growthFactor);
+    readNumber("MEM_POOL_MAX_BLOCK_BYTES", Defaults.maxBlockBytes);
+    readNumber("MEM_POOL_DIRECT_THRESHOLD", Defaults.directThreshold);
+    readNumber("MEM_POOL_UNIFORM_BLOCK_BYTES", Defaults.uniformBlockBytes);
+    readFlag("MEM_POOL_PAGE_EXACT", Defaults.pageExactBlocks);
+    readFlag("MEM_POOL_PREFAULT", Defaults.prefault);
+    readFlag("MEM_POOL_STATS", Defaults.printStatistics);
+    return Defaults;
+  }
+
+  /// Same as fromEnvironment(PoolConfig), starting from the defaults
+  static PoolConfig fromEnvironment() noexcept {
+    return fromEnvironment(PoolConfig());
+  }
+
+private:
+  static void readNumber(const char *Var, size_t &Value) noexcept {
+    const char *value = std::getenv(Var);
+    if (!value || !*value)
+      return;
+    char *end;
+    auto num = std::strtoull(value, &end, 0);
+    if (!*end)
+      Value = num;
+  }
+
+  static void readFlag(const char *Var, bool &Value) noexcept {
+    const char *value = std::getenv(Var);
+    if (!value)
+      return;
+    Value = std::strcmp(value, "0") && std::strcmp(value, "false") &&
+            std::strcmp(value, "off");
+  }
+};
+
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+/// \file
+/// Optional USDT (user-level statically defined tracing) probes at the slow
+/// paths of the pools, e.g. for observing block churn of a live process with
+/// \c bpftrace or \c perf without recompiling it:
+///
+///   bpftrace -e 'usdt:./app:mem:driver_block_create { @[arg0] = count(); }'
+///
+/// The probes are enabled, if \c <sys/sdt.h> (systemtap-sdt-dev) is available
+/// and MEM_DISABLE_PROBES is not defined. An enabled probe compiles to a
+/// single NOP plus an ELF note in the \c .note.stapsdt section; disabled
+/// probes compile to nothing.
+///
+/// Provider: \c mem. Probes and their arguments:
+/// - pool_block_create(block, numObjects, objectSize): PoolAllocator
+/// - pool_block_destroy(block): PoolAllocator
+/// - driver_block_create(block, numObjects, objectSize): SubtypeAllocatorDriver
+/// - driver_block_destroy(block): SubtypeAllocatorDriver
+/// - driver_reserve(id, numObjects): SubtypeAllocatorDriver::reserve()
+/// - driver_new_size_class(id, objectSize, objectAlignment):
+///   SubtypeAllocatorDriver::getId() registering a new size-class
+/// - refc_release(object, id): final release of a refc-managed object
+
+#if !defined(MEM_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MEM_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef MEM_HAVE_PROBES
+#define MEM_PROBE1(Name, A1) DTRACE_PROBE1(mem, Name, A1)
+#define MEM_PROBE2(Name, A1, A2) DTRACE_PROBE2(mem, Name, A1, A2)
+#define MEM_PROBE3(Name, A1, A2, A3) DTRACE_PROBE3(mem, Name, A1, A2, A3)
+#else
+#define MEM_PROBE1(Name, A1) ((void)0)
+#define MEM_PROBE2(Name, A1, A2) ((void)0)
+#define MEM_PROBE3(Name, A1, A2, A3) ((void)0)
+#endif
\ No newline at end of file
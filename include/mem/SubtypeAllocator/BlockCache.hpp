@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "mem/SubtypeAllocator/detail/SubtypeAllocatorDriverBase.hpp"
+
+namespace mem {
+
+/// \brief A thread-safe cache of memory blocks that is the parent of any
+/// number of (child) SubtypeAllocatorDrivers, e.g. one per request or task.
+///
+/// A child driver takes its blocks from the cache of its parent and gives
+/// them back when it is released or destroyed, instead of returning them to
+/// the system. The same holds for the storage of their bookkeeping (see
+/// SubtypeAllocatorDriverBase::Metadata). At steady state, short-lived
+/// children therefore run without any calls to the system allocator. Each
+/// child itself stays single-threaded, but children on different threads may
+/// share the same parent. The parent must outlive all of its children.
+///
+/// Blocks are only reused for blocks of exactly the same size and alignment.
+/// Objects that are not pooled (see PoolConfig::directThreshold) bypass the
+/// cache.
+class BlockCache {
+  using Metadata = detail::SubtypeAllocatorDriverBase::Metadata;
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct Bucket {
+    size_t numBytes;
+    size_t alignment;
+    FreeBlock *head = nullptr;
+    size_t numBlocks = 0;
+
+    Bucket(size_t NumBytes, size_t Alignment) noexcept
+        : numBytes(NumBytes), alignment(Alignment) {}
+  };
+
+  mutable std::mutex mtx;
+  std::vector<Bucket> buckets;
+  /// The bookkeeping storage of destroyed children
+  std::vector<Metadata> metadata;
+  size_t cachedBytes = 0;
+  size_t maxCachedBytes;
+
+  Bucket *findBucket(size_t NumBytes, size_t Alignment) noexcept {
+    for (auto &bucket : buckets) {
+      if (bucket.numBytes == NumBytes && bucket.alignment == Alignment)
+        return &bucket;
+    }
+    return nullptr;
+  }
+
+public:
+  /// \param MaxCachedBytes Blocks that are given back while the cache already
+  /// holds this many bytes are returned to the system instead
+  explicit BlockCache(size_t MaxCachedBytes = SIZE_MAX) noexcept
+      : maxCachedBytes(MaxCachedBytes) {}
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+  ~BlockCache() { trim(); }
+
+  /// \brief Allocates \p NumBytes bytes with an alignment of \p Alignment
+  /// from the system, the same way as a SubtypeAllocatorDriver does for its
+  /// blocks.
+  static void *allocateBlock(size_t NumBytes, size_t Alignment, bool Zeroed) {
+    if (Alignment <= alignof(std::max_align_t)) {
+      auto *mem = Zeroed ? std::calloc(NumBytes, 1) : std::malloc(NumBytes);
+      if (!mem)
+        throw std::bad_alloc();
+      return mem;
+    }
+    auto *mem = ::new (std::align_val_t{Alignment}) char[NumBytes];
+    if (Zeroed)
+      std::memset(mem, 0, NumBytes);
+    return mem;
+  }
+
+  /// Returns a block that has been allocated with allocateBlock() to the
+  /// system
+  static void freeBlock(void *Blck, size_t Alignment) noexcept {
+    if (Alignment <= alignof(std::max_align_t)) {
+      std::free(Blck);
+      return;
+    }
+    ::operator delete[](static_cast<char *>(Blck),
+                        std::align_val_t{Alignment});
+  }
+
+  /// \brief Takes a cached block of \p NumBytes bytes with an alignment of \p
+  /// Alignment out of the cache.
+  /// \returns The block or nullptr, if no such block is cached. Its contents
+  /// are unspecified.
+  void *acquire(size_t NumBytes, size_t Alignment) noexcept {
+    std::lock_guard<std::mutex> lck(mtx);
+    auto *bucket = findBucket(NumBytes, Alignment);
+    if (!bucket || !bucket->head)
+      return nullptr;
+
+    auto *ret = bucket->head;
+    bucket->head = ret->next;
+    --bucket->numBlocks;
+    cachedBytes -= NumBytes;
+    return ret;
+  }
+
+  /// \brief Gives a block back to the cache that has been obtained with
+  /// acquire() or allocateBlock() for the same \p NumBytes and \p Alignment.
+  void recycle(void *Blck, size_t NumBytes, size_t Alignment) noexcept {
+    {
+      std::lock_guard<std::mutex> lck(mtx);
+      auto *bucket = findBucket(NumBytes, Alignment);
+      if (!bucket && cachedBytes + NumBytes <= maxCachedBytes) {
+        try {
+          bucket = &buckets.emplace_back(NumBytes, Alignment);
+        } catch (const std::bad_alloc &) {
+          // Give the block back to the system instead
+        }
+      }
+      if (bucket && cachedBytes + NumBytes <= maxCachedBytes) {
+        auto *fb = static_cast<FreeBlock *>(Blck);
+        fb->next = bucket->head;
+        bucket->head = fb;
+        ++bucket->numBlocks;
+        cachedBytes += NumBytes;
+        return;
+      }
+    }
+    freeBlock(Blck, Alignment);
+  }
+
+  /// \brief Moves the bookkeeping storage of a destroyed child into \p Out,
+  /// if there is any. \returns true, iff \p Out has been replaced.
+  bool acquireMetadata(Metadata &Out) noexcept {
+    std::lock_guard<std::mutex> lck(mtx);
+    if (metadata.empty())
+      return false;
+    Out = std::move(metadata.back());
+    metadata.pop_back();
+    return true;
+  }
+
+  /// \brief Keeps the (empty) bookkeeping storage \p M of a child for the
+  /// next one. See acquireMetadata().
+  void recycleMetadata(Metadata &&M) noexcept {
+    std::lock_guard<std::mutex> lck(mtx);
+    try {
+      metadata.push_back(std::move(M));
+    } catch (const std::bad_alloc &) {
+      // Just drop it
+    }
+  }
+
+  /// Returns all cached blocks to the system
+  void trim() noexcept {
+    std::vector<Bucket> drained;
+    {
+      std::lock_guard<std::mutex> lck(mtx);
+      drained.swap(buckets);
+      cachedBytes = 0;
+    }
+    for (auto &bucket : drained) {
+      for (auto *fb = bucket.head; fb;) {
+        auto *next = fb->next;
+        freeBlock(fb, bucket.alignment);
+        fb = next;
+      }
+    }
+  }
+
+  /// Returns the number of blocks that are currently cached
+  size_t getNumCachedBlocks() const noexcept {
+    std::lock_guard<std::mutex> lck(mtx);
+    size_t ret = 0;
+    for (auto &bucket : buckets)
+      ret += bucket.numBlocks;
+    return ret;
+  }
+
+  /// Returns the total size of the blocks that are currently cached
+  size_t getCachedBytes() const noexcept {
+    std::lock_guard<std::mutex> lck(mtx);
+    return cachedBytes;
+  }
+};
+} // namespace mem
\ No newline at end of file
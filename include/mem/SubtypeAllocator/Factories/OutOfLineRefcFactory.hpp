@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "mem/SubtypeAllocator/ool_refc.hpp"
+#include "mem/Utility.hpp"
+
+namespace mem {
+
+/// \brief A factory that is able to create objects of the types given in \p Ts
+/// and wrap them into a \c mem::ool_refc.
+///
+/// Like RefcFactory, but the reference-counters are not stored in front of the
+/// objects: Each type is allocated from separate slabs of
+/// detail::ool_slab::SlabBytes bytes, and the counters of a slab live in a
+/// dense array of their own. Use it for object graphs that are built once and
+/// then shared with \c fork()ed worker processes, which only read the objects
+/// but copy the smart-pointers to them.
+///
+/// \tparam Ts The types of objects this factory can allocate.
+template <typename... Ts> class OutOfLineRefcFactory final {
+  using slab_t = detail::ool_slab;
+
+  struct Pool {
+    slab_t *slabs = nullptr;
+    void *freeList = nullptr;
+    char *pos = nullptr;
+    char *end = nullptr;
+  };
+
+  std::array<Pool, sizeof...(Ts)> Pools;
+
+  /// Returns the number of bytes occupied by each object of type \p U
+  template <typename U> static constexpr size_t chunkSize() noexcept {
+    return (std::max(sizeof(U), sizeof(void *)) + alignof(U) - 1) &
+           ~(alignof(U) - 1);
+  }
+
+  template <typename U> static constexpr size_t dataOffset() noexcept {
+    return (sizeof(slab_t) + alignof(U) - 1) & ~(alignof(U) - 1);
+  }
+
+  template <typename U>
+  static void releaseObject(void *Owner, void *Obj) noexcept {
+    static_cast<U *>(Obj)->~U();
+    auto &pool = *static_cast<Pool *>(Owner);
+    *static_cast<void **>(Obj) = pool.freeList;
+    pool.freeList = Obj;
+  }
+
+  template <typename U> void addSlab(Pool &P) {
+    static_assert(dataOffset<U>() + chunkSize<U>() <= slab_t::SlabBytes,
+                  "The objects are too large for the slabs of an "
+                  "OutOfLineRefcFactory");
+
+    const auto numSlots =
+        (slab_t::SlabBytes - dataOffset<U>()) / chunkSize<U>();
+    auto *counters = new std::atomic_size_t[numSlots];
+
+    auto *mem = static_cast<char *>(::operator new(
+        slab_t::SlabBytes, std::align_val_t{slab_t::SlabBytes}));
+    auto *slab = new (mem) slab_t{counters, dataOffset<U>(), chunkSize<U>(),
+                                  &releaseObject<U>, &P, P.slabs};
+    P.slabs = slab;
+    P.pos = mem + dataOffset<U>();
+    P.end = P.pos + numSlots * chunkSize<U>();
+  }
+
+  template <typename U> void *allocate(Pool &P) {
+    if (auto *ret = P.freeList) {
+      P.freeList = *static_cast<void **>(ret);
+      return ret;
+    }
+    if (P.pos == P.end)
+      addSlab<U>(P);
+    auto *ret = P.pos;
+    P.pos += chunkSize<U>();
+    return ret;
+  }
+
+public:
+  /// Default constructor. Does not allocate any objects
+  OutOfLineRefcFactory() noexcept = default;
+  OutOfLineRefcFactory(const OutOfLineRefcFactory &) = delete;
+  OutOfLineRefcFactory &operator=(const OutOfLineRefcFactory &) = delete;
+
+  /// Frees all slabs. Like for RefcFactory, the remaining objects are not
+  /// destroyed.
+  ~OutOfLineRefcFactory() {
+    for (auto &pool : Pools) {
+      for (auto *slab = pool.slabs; slab;) {
+        auto *next = slab->next;
+        delete[] slab->counters;
+        ::operator delete(slab, std::align_val_t{slab_t::SlabBytes});
+        slab = next;
+      }
+    }
+  }
+
+  /// \brief Creates an object of type \p U and forwards the arguments \p args
+  /// to \p U's constructor.
+  /// \returns The newly created object wrapped into an \c ool_refc
+  template <typename U, typename... Args> ool_refc<U> create(Args &&... args) {
+    auto &pool = Pools[tuple_index_v<U, Ts...>];
+    auto *mem = allocate<U>(pool);
+    try {
+      new (mem) U(std::forward<Args>(args)...);
+    } catch (...) {
+      *static_cast<void **>(mem) = pool.freeList;
+      pool.freeList = mem;
+      throw;
+    }
+
+    slab_t::of(mem)->counterOf(mem).store(1, std::memory_order_relaxed);
+    return ool_refc<U>(detail::preallocated, static_cast<U *>(mem));
+  }
+};
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+#include "mem/SubtypeAllocator/refc.hpp"
+#include "mem/SubtypeAllocator/unique_refc.hpp"
+#include "mem/Utility.hpp"
+
+namespace mem {
+
+/// \brief A thread-safe factory like RefcFactory for building large object
+/// graphs in parallel, e.g. from a thread pool or within
+/// <tt>std::for_each(std::execution::par, ...)</tt>.
+///
+/// Every thread that creates objects gets a shard of its own: a
+/// SubtypeAllocatorDriver that only this thread allocates from, so create()
+/// does not synchronize with other threads. The resulting refcs are valid in
+/// all threads. Releasing an object in the thread that has created it puts it
+/// on the shard's plain free-list; any other thread hands it back with a
+/// lock-free push (see SubtypeAllocatorDriver::enableRemoteDeallocation()).
+///
+/// Each thread caches the shard of the factory it has used last; the first
+/// create() per thread, and switching between factories, takes a mutex.
+/// Like for RefcFactory, the remaining objects are not destroyed when the
+/// factory is destroyed.
+///
+/// \tparam AllocBlockSize The number of objects of one size to allocate at
+/// once per shard. \tparam Ts The types of objects this factory can allocate.
+template <size_t AllocBlockSize, typename... Ts>
+class ParallelRefcFactory final {
+  using driver_t = SubtypeAllocatorDriver<AllocBlockSize>;
+
+  struct Shard {
+    driver_t Driver;
+    std::array<typename driver_t::UserAllocatorId, sizeof...(Ts)> Ids;
+
+    Shard() {
+      Ids = {Driver.template getId<typename refc<Ts>::one_allocation>(
+          default_lifetime_v<Ts>)...};
+      for (auto id : Ids)
+        Driver.enableRemoteDeallocation(id);
+    }
+  };
+
+  struct ShardCache {
+    uint64_t Serial = 0;
+    Shard *Current = nullptr;
+  };
+
+  inline static std::atomic<uint64_t> NextSerial{1};
+
+  /// Identifies this factory in the ShardCache of each thread, even if
+  /// another factory is created at the same address later
+  const uint64_t Serial;
+  std::mutex ShardsMtx;
+  std::unordered_map<std::thread::id, std::unique_ptr<Shard>> Shards;
+
+  static ShardCache &threadCache() noexcept {
+    thread_local ShardCache cache;
+    return cache;
+  }
+
+  Shard &currentShard() {
+    auto &cache = threadCache();
+    if (__builtin_expect(cache.Serial == Serial, true))
+      return *cache.Current;
+
+    std::lock_guard<std::mutex> lck(ShardsMtx);
+    auto &shard = Shards[std::this_thread::get_id()];
+    if (!shard)
+      shard = std::make_unique<Shard>();
+    cache = {Serial, shard.get()};
+    return *shard;
+  }
+
+public:
+  /// Default constructor. Does not allocate any objects
+  explicit ParallelRefcFactory()
+      : Serial(NextSerial.fetch_add(1, std::memory_order_relaxed)) {}
+  ParallelRefcFactory(const ParallelRefcFactory &) = delete;
+  ParallelRefcFactory &operator=(const ParallelRefcFactory &) = delete;
+
+  /// \brief Creates an object of type \p U in the shard of the calling thread
+  /// and forwards the arguments \p args to \p U's constructor.
+  /// \returns The newly created object wrapped into a \c refc
+  template <typename U, typename... Args> refc<U> create(Args &&... args) {
+    auto &shard = currentShard();
+    return refc<U>(&shard.Driver, shard.Ids[tuple_index_v<U, Ts...>],
+                   std::forward<Args>(args)...);
+  }
+
+  /// \brief Same as create(), but the new object is owned uniquely, see
+  /// RefcFactory::create_unique().
+  /// \returns The newly created object wrapped into a \c unique_refc
+  template <typename U, typename... Args>
+  unique_refc<U> create_unique(Args &&... args) {
+    auto &shard = currentShard();
+    auto id = shard.Ids[tuple_index_v<U, Ts...>];
+    return unique_refc<U>(detail::preallocated, shard.Driver.allocate(id),
+                          &shard.Driver, id, std::forward<Args>(args)...);
+  }
+
+  /// Returns the number of threads that have created objects with this factory
+  size_t getNumShards() {
+    std::lock_guard<std::mutex> lck(ShardsMtx);
+    return Shards.size();
+  }
+};
+} // namespace mem
\ No newline at end of file
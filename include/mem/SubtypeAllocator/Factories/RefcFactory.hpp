@@ -1,10 +1,19 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <tuple>
+#include <vector>
 
+#include "mem/SubtypeAllocator/Relocatable.hpp"
+#include "mem/SubtypeAllocator/RelocationTable.hpp"
 #include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+#include "mem/SubtypeAllocator/detail/InternTable.hpp"
 #include "mem/SubtypeAllocator/refc.hpp"
+#include "mem/SubtypeAllocator/refc_shared_ptr.hpp"
+#include "mem/SubtypeAllocator/unique_refc.hpp"
 #include "mem/Utility.hpp"
 
 namespace mem {
@@ -19,23 +28,88 @@ template <size_t AllocBlockSize, typename... Ts> class RefcFactory final {
   std::array<typename SubtypeAllocatorDriver<AllocBlockSize>::UserAllocatorId,
              sizeof...(Ts)>
       Ids;
+  static constexpr auto InvalidId =
+      SubtypeAllocatorDriver<AllocBlockSize>::InvalidId;
+  /// The Ids for objects that are created with an explicit long_lived hint.
+  /// They are registered on first use, see create(long_lived_t, ...).
+  decltype(Ids) LongLivedIds;
+  std::tuple<detail::InternTable<Ts>...> InternTables;
 
   template <size_t... Ns>
   std::array<size_t, sizeof...(Ns)> initializeIds(std::index_sequence<Ns...>) {
     return {Driver.template getId<typename refc<
-        std::tuple_element_t<Ns, std::tuple<Ts...>>>::one_allocation>()...};
+        std::tuple_element_t<Ns, std::tuple<Ts...>>>::one_allocation>(
+        default_lifetime_v<std::tuple_element_t<Ns, std::tuple<Ts...>>>)...};
+  }
+
+  /// Returns the offsets of the refc_members of \p U from the start of its
+  /// control-block
+  template <typename U> static std::vector<size_t> refcOffsets() {
+    using alloc_t = typename refc<U>::one_allocation;
+    // Only the addresses of the members are computed; no object is accessed
+    alignas(alloc_t) unsigned char buf[sizeof(alloc_t)];
+    auto *obj = reinterpret_cast<U *>(&reinterpret_cast<alloc_t *>(buf)->Data);
+
+    std::vector<size_t> ret;
+    std::apply(
+        [&](auto... Members) {
+          static_assert(
+              (detail::is_refc<std::decay_t<decltype(obj->*Members)>>::value &&
+               ...),
+              "mem::refc_members must only name members of type mem::refc");
+          (ret.push_back(reinterpret_cast<unsigned char *>(&(obj->*Members)) -
+                         buf),
+           ...);
+        },
+        refc_members<U>::value);
+    return ret;
+  }
+
+  /// Returns the offsets of the refc members for each Id that holds objects
+  /// of \p Ts. Throws, if types of the same Id declare different members.
+  std::vector<std::optional<std::vector<size_t>>> getRefcOffsetsById() const {
+    std::vector<std::optional<std::vector<size_t>>> ret(Driver.getNumIds());
+    const std::vector<size_t> offsets[] = {refcOffsets<Ts>()...};
+    for (size_t i = 0; i < sizeof...(Ts); ++i) {
+      for (auto id : {Ids[i], LongLivedIds[i]}) {
+        if (id == InvalidId)
+          continue;
+        if (!ret[id])
+          ret[id] = offsets[i];
+        else if (*ret[id] != offsets[i])
+          throw std::invalid_argument(
+              "clone_all: types of the same size declare refc members at "
+              "different offsets");
+      }
+    }
+    return ret;
   }
 
 public:
   /// Default constructor. Does not allocate any objects
   explicit RefcFactory() {
     Ids = initializeIds(std::make_index_sequence<sizeof...(Ts)>{});
+    LongLivedIds.fill(InvalidId);
     // for (auto id : Ids) {
     //   std::cerr << id << " ";
     // }
     // std::cerr << std::endl;
   }
 
+  /// \brief Creates a factory whose driver is configured at runtime, e.g. with
+  /// PoolConfig::fromEnvironment(). See SubtypeAllocatorDriver.
+  explicit RefcFactory(const PoolConfig &Config) : Driver(Config) {
+    Ids = initializeIds(std::make_index_sequence<sizeof...(Ts)>{});
+    LongLivedIds.fill(InvalidId);
+  }
+
+  /// \brief Creates a factory whose driver is a child of \p Parent, e.g. for
+  /// the objects of a single request. See SubtypeAllocatorDriver.
+  explicit RefcFactory(BlockCache &Parent) : Driver(Parent) {
+    Ids = initializeIds(std::make_index_sequence<sizeof...(Ts)>{});
+    LongLivedIds.fill(InvalidId);
+  }
+
   /// Constructor. Can control, how much space should be available initially for
   /// each type. \param initialCapacities This array contains an
   /// initialCapacity
@@ -45,11 +119,14 @@ public:
   explicit RefcFactory(
       const std::array<size_t, sizeof...(Ts)> &initialCapacities) {
     Ids = initializeIds(std::make_index_sequence<sizeof...(Ts)>{});
+    LongLivedIds.fill(InvalidId);
 
     std::array<size_t, sizeof...(Ts)> initCapById;
     initCapById.fill(0);
 
-    const size_t numIds = Driver.getNumIds();
+    // The Ids of the default lifetime are created first, so they are all
+    // smaller than sizeof...(Ts)
+    const size_t numIds = std::min(Driver.getNumIds(), initCapById.size());
 
     for (size_t i = 0; i < initCapById.size(); ++i) {
       auto currId = Ids[i];
@@ -58,10 +135,23 @@ public:
 
     for (size_t i = 0; i < numIds; ++i) {
       if (initCapById[i])
-        Driver.reserve(initCapById[i]);
+        Driver.reserve(i, initCapById[i]);
     }
   }
 
+  /// \brief Releases all objects created by this factory at once without
+  /// calling their destructors or visiting them, e.g. at shutdown or to drop a
+  /// large cache. The factory can be used to create new objects afterwards.
+  ///
+  /// This is the explicit opt-in to skip the destructors of the objects: No
+  /// refc to an object of this factory must be accessed or destroyed
+  /// afterwards. Put the remaining ones into \c nullptr state with
+  /// mem::discard() or let them go out of scope before.
+  void abandon() noexcept {
+    Driver.release();
+    std::apply([](auto &... Tables) { (Tables.clear(), ...); }, InternTables);
+  }
+
   /// \brief Creates an object of type \p U and forwards the arguments \p args
   /// to \p U's constructor.
   /// \returns The newly created object wrapped into a \c refc
@@ -69,5 +159,158 @@ public:
     auto id = Ids[tuple_index_v<U, Ts...>];
     return refc<U>(&Driver, id, std::forward<Args>(args)...);
   }
+
+  /// \brief Same as create(), but the new object is owned uniquely and does
+  /// not touch its reference-counter until the unique_refc is converted into a
+  /// refc, e.g. for the many objects that are never shared.
+  /// \returns The newly created object wrapped into a \c unique_refc
+  template <typename U, typename... Args>
+  unique_refc<U> create_unique(Args &&... args) {
+    auto id = Ids[tuple_index_v<U, Ts...>];
+    return unique_refc<U>(detail::preallocated, Driver.allocate(id), &Driver,
+                          id, std::forward<Args>(args)...);
+  }
+
+  /// \brief Same as create(), but places the new object in the blocks for
+  /// long-lived objects, e.g. for caches that outlive many short-lived
+  /// temporaries of the same size. This keeps the long-lived objects from
+  /// pinning the (otherwise free) blocks of the temporaries and vice versa.
+  /// See mem::default_lifetime for setting the lifetime of a whole type.
+  /// \returns The newly created object wrapped into a \c refc
+  template <typename U, typename... Args>
+  refc<U> create(long_lived_t, Args &&... args) {
+    auto &id = LongLivedIds[tuple_index_v<U, Ts...>];
+    if (__builtin_expect(id == InvalidId, false))
+      id = Driver.template getId<typename refc<U>::one_allocation>(
+          Lifetime::Long);
+    return refc<U>(&Driver, id, std::forward<Args>(args)...);
+  }
+
+  /// \brief Creates an object of type \p U like create(), but returns an
+  /// already existing object instead, if it has been interned before and
+  /// compares equal to the new one (hash-consing). Structurally equal interned
+  /// objects can therefore be compared by pointer-equality.
+  ///
+  /// Interned objects are looked up using \c std::hash<U> and \c
+  /// std::equal_to<U>. They must not be modified while interned and are
+  /// removed from the lookup-table when their last reference is released.
+  /// \returns The interned object wrapped into a \c refc
+  template <typename U, typename... Args> refc<U> intern(Args &&... args) {
+    auto &table = std::get<tuple_index_v<U, Ts...>>(InternTables);
+    return table.intern(Driver, create<U>(std::forward<Args>(args)...));
+  }
+
+  /// \brief Creates a deep copy of all objects created by this factory by
+  /// copying the memory blocks in bulk and relocating the refcs between the
+  /// copied objects.
+  ///
+  /// This requires all types in \p Ts to be trivially relocatable (see
+  /// mem::is_trivially_relocatable), i.e. they can be copied with \c memcpy
+  /// when ignoring their refc members. Only the refcs declared with
+  /// mem::refc_members are redirected to the copies; all other members are
+  /// copied as they are. refcs that point outside of this factory (other than
+  /// to singletons) are not supported. Types of the same size must declare
+  /// their refc members at the same offsets; otherwise, throws \c
+  /// std::invalid_argument.
+  ///
+  /// The reference-counters of the copies only count the references from other
+  /// copied objects. To access the cloned graph, translate the (external) root
+  /// refcs of this factory with \p Relocations. Interned objects are not
+  /// interned in the clone.
+  /// \param[out] Relocations Receives the mapping from the objects in this
+  /// factory to their copies
+  /// \returns The clone of this factory that owns all copied objects
+  std::unique_ptr<RefcFactory> clone_all(RelocationTable &Relocations) const {
+    static_assert((is_trivially_relocatable_v<Ts> && ...),
+                  "clone_all requires all types to be trivially relocatable; "
+                  "see mem::is_trivially_relocatable");
+    using counter = detail::refc_counter;
+
+    const auto offsetsById = getRefcOffsetsById();
+
+    auto clone = std::make_unique<RefcFactory>();
+    auto &driver = clone->Driver;
+    Driver.cloneInto(driver, Relocations);
+
+    // Other Ids hold the control blocks of to_shared_ptr()
+    const auto numIds = offsetsById.size();
+    for (size_t id = 0; id < numIds; ++id) {
+      if (!offsetsById[id])
+        continue;
+      driver.forEachAllocated(id, [&](void *Obj) {
+        auto *ctr = static_cast<counter *>(Obj);
+        // Immortal objects stay immortal in the clone
+        ctr->Ctr.store(ctr->Ctr.load(std::memory_order_relaxed) &
+                           counter::ImmortalBit,
+                       std::memory_order_relaxed);
+        ctr->Id = id;
+        ctr->Del = &driver;
+      });
+    }
+
+    for (size_t id = 0; id < numIds; ++id) {
+      if (!offsetsById[id] || offsetsById[id]->empty())
+        continue;
+      driver.forEachAllocated(id, [&](void *Obj) {
+        for (auto offset : *offsetsById[id]) {
+          // A refc consists of the pointer to its control-block only
+          auto *&word = *reinterpret_cast<void **>(static_cast<char *>(Obj) +
+                                                   offset);
+          bool isObjectStart;
+          if (auto *nw = Relocations.relocate(word, isObjectStart)) {
+            word = nw;
+            if (isObjectStart)
+              static_cast<counter *>(nw)->Ctr.fetch_add(
+                  1, std::memory_order_relaxed);
+          }
+        }
+      });
+    }
+
+    return clone;
+  }
+
+  /// \brief Shares the object managed by \p Rc, which has been created by this
+  /// factory, with APIs that require a \c std::shared_ptr, without copying
+  /// it. The control block of the \c std::shared_ptr is allocated from this
+  /// factory. See mem::to_shared_ptr().
+  template <typename U> std::shared_ptr<U> to_shared_ptr(refc<U> Rc) {
+    return mem::to_shared_ptr(std::move(Rc), Driver);
+  }
+
+  /// \brief Same as create(), but tries to place the new object close to the
+  /// object pointed to by \p Hint, e.g. a child next to its parent. Improves
+  /// data locality, especially after objects have been recycled from the
+  /// free-list.
+  /// See SubtypeAllocatorDriver::allocate_near().
+  /// \returns The newly created object wrapped into a \c refc
+  template <typename U, typename V, typename... Args>
+  refc<U> create_near(const refc<V> &Hint, Args &&... args) {
+    if (!Hint)
+      return create<U>(std::forward<Args>(args)...);
+
+    auto id = Ids[tuple_index_v<U, Ts...>];
+    return refc<U>(detail::preallocated, Driver.allocate_near(id, Hint.get()),
+                   &Driver, id, std::forward<Args>(args)...);
+  }
+
+  /// \brief Creates a value-initialized object of type \p U, i.e. same as
+  /// create<U>() for a \p U with a user-provided default constructor.
+  ///
+  /// For trivially default-constructible types, the object is placed in memory
+  /// that is known to be zero, which avoids clearing chunks from freshly
+  /// allocated blocks again.
+  /// Note: This assumes that the all-zero bit-pattern represents the
+  /// value-initialized object, which does not hold for member-pointers.
+  /// \returns The newly created object wrapped into a \c refc
+  template <typename U> refc<U> create_value_initialized() {
+    if constexpr (std::is_trivially_default_constructible_v<U>) {
+      auto id = Ids[tuple_index_v<U, Ts...>];
+      return refc<U>(detail::zero_initialized, Driver.allocate_zeroed(id),
+                     &Driver, id);
+    } else {
+      return create<U>();
+    }
+  }
 };
 } // namespace mem
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "mem/SubtypeAllocator/Factories/DefaultSharedPtrFactory.hpp"
+#include "mem/SubtypeAllocator/Factories/SharedPtrFactory.hpp"
+
+namespace mem {
+
+/// \brief A factory that returns \c std::shared_ptrs created either with a
+/// pooled SharedPtrFactory or with a DefaultSharedPtrFactory (i.e. \c
+/// std::make_shared), chosen at construction time. Allows A/B-comparing both
+/// allocation strategies without building separate binaries.
+///
+/// \tparam AllocBlockSize The number of objects of one size to allocate at
+/// once, if the pool is used. \tparam Ts The types of objects this factory can
+/// allocate.
+template <size_t AllocBlockSize, typename... Ts>
+class SwitchableSharedPtrFactory final {
+  SharedPtrFactory<AllocBlockSize, Ts...> Pooled;
+  DefaultSharedPtrFactory<Ts...> Default;
+  bool UsePool;
+  size_t NumPooledCreations = 0;
+  size_t NumDefaultCreations = 0;
+
+public:
+  /// The environment variable that is read by the default constructor
+  static constexpr const char *EnvironmentVariable = "MEM_USE_POOL";
+
+  /// \brief Reads the backend to use from the environment variable \p Var.
+  /// \returns \p Default, if \p Var is not set; \c false, if it is set to "0",
+  /// "false" or "off"; \c true otherwise
+  static bool usePoolFromEnvironment(const char *Var = EnvironmentVariable,
+                                     bool Default = true) noexcept {
+    const char *value = std::getenv(Var);
+    if (!value)
+      return Default;
+    return std::strcmp(value, "0") && std::strcmp(value, "false") &&
+           std::strcmp(value, "off");
+  }
+
+  /// Constructor. Uses the pool, iff \p UsePool is \c true
+  explicit SwitchableSharedPtrFactory(bool UsePool) : UsePool(UsePool) {}
+
+  /// Default constructor. Uses the pool, unless disabled via the environment
+  /// variable \c MEM_USE_POOL
+  explicit SwitchableSharedPtrFactory()
+      : SwitchableSharedPtrFactory(usePoolFromEnvironment()) {}
+
+  /// \brief Creates an object of type \p U with the selected backend and
+  /// forwards the arguments \p args to \p U's constructor.
+  /// \returns The newly created object wrapped into a \c std::shared_ptr
+  template <typename U, typename... Args>
+  std::shared_ptr<U> create(Args &&... args) {
+    if (UsePool) {
+      ++NumPooledCreations;
+      return Pooled.template create<U>(std::forward<Args>(args)...);
+    }
+    ++NumDefaultCreations;
+    return Default.template create<U>(std::forward<Args>(args)...);
+  }
+
+  /// Checks whether this factory allocates from the pool
+  bool usesPool() const noexcept { return UsePool; }
+
+  /// Returns the number of objects created with the pooled backend
+  size_t getNumPooledCreations() const noexcept { return NumPooledCreations; }
+  /// Returns the number of objects created with \c std::make_shared
+  size_t getNumDefaultCreations() const noexcept {
+    return NumDefaultCreations;
+  }
+};
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <type_traits>
+
+namespace mem {
+
+/// \brief The expected lifetime of an allocated object. Objects of different
+/// lifetime classes are placed in separate block chains of a
+/// SubtypeAllocatorDriver, even if they have the same size, such that
+/// long-lived objects do not pin the blocks of short-lived temporaries.
+enum class Lifetime : unsigned char {
+  /// Objects that are released again soon, e.g. per-request temporaries
+  Default,
+  /// Objects that live for (almost) the whole program, e.g. caches or
+  /// configuration
+  Long,
+};
+
+/// Tag type for creating a long-lived object, e.g. with RefcFactory::create()
+struct long_lived_t {
+  explicit long_lived_t() = default;
+};
+inline constexpr long_lived_t long_lived{};
+
+/// \brief The Lifetime of the objects of type \p T that are created without an
+/// explicit lifetime hint. Specialize this trait for types whose objects are
+/// typically long-lived.
+template <typename T>
+struct default_lifetime
+    : std::integral_constant<Lifetime, Lifetime::Default> {};
+
+template <typename T>
+inline constexpr Lifetime default_lifetime_v = default_lifetime<T>::value;
+
+} // namespace mem
\ No newline at end of file
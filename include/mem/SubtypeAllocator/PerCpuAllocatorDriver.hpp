@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+#include "mem/SubtypeAllocator/detail/Rseq.hpp"
+
+namespace mem {
+
+/// \brief A thread-safe front end for the size-classes of a
+/// SubtypeAllocatorDriver that caches freed objects per CPU instead of per
+/// thread.
+///
+/// The memory parked in the caches is therefore bounded by the number of CPUs
+/// (times the number of size-classes and CacheCapacity), no matter how many
+/// threads allocate. Each cache holds a stack of up to CacheCapacity objects
+/// per size-class. Objects move between the caches and the shared
+/// SubtypeAllocatorDriver in batches under a separate mutex, which is never
+/// taken while holding the lock of a cache.
+///
+/// On x86-64 and AArch64 Linux with glibc 2.35 or newer, the caches are
+/// accessed with restartable sequences (see detail/Rseq.hpp): the current CPU
+/// is read from the rseq area of the thread, and a push or pop is a handful of
+/// instructions that the kernel restarts if the thread is preempted or
+/// migrated, without any lock or atomic instruction. Elsewhere, or if the
+/// kernel does not support rseq, each cache is guarded by its own mutex, which
+/// is rarely contended, since only the threads running on its CPU use it; the
+/// CPU is then read with \c sched_getcpu() or, if that is not available, every
+/// thread is assigned to one of the caches round-robin. usesRseq() tells which
+/// of both is active.
+///
+/// Only the first MaxCachedIds size-classes are cached; (de-)allocations of
+/// the others go directly to the central driver.
+///
+/// \tparam AllocationBlockSize The number of objects to allocate at once, see
+/// SubtypeAllocatorDriver
+template <size_t AllocationBlockSize = 1024> class PerCpuAllocatorDriver {
+public:
+  using UserAllocatorId =
+      typename SubtypeAllocatorDriver<AllocationBlockSize>::UserAllocatorId;
+
+  /// The default for the largest number of objects per size-class and CPU
+  static constexpr size_t DefaultCacheCapacity = 64;
+  /// The number of size-classes that are cached per CPU
+  static constexpr size_t MaxCachedIds = 64;
+
+private:
+  using Bin = detail::CpuBin;
+
+  /// A list of objects that moves between the caches and the central driver
+  struct Batch {
+    void *head = nullptr;
+    size_t count = 0;
+
+    void add(void *Obj) noexcept {
+      *static_cast<void **>(Obj) = head;
+      head = Obj;
+      ++count;
+    }
+  };
+
+  struct alignas(64) CpuCache {
+    Bin bins[MaxCachedIds];
+    /// Only used without rseq
+    std::mutex mtx;
+  };
+
+  SubtypeAllocatorDriver<AllocationBlockSize> central;
+  std::mutex centralMtx;
+  std::unique_ptr<CpuCache[]> caches;
+  size_t numCaches;
+  size_t cacheCapacity;
+  /// The storage of Bin::slots, one array for all CPUs per cached Id
+  std::vector<std::unique_ptr<void *[]>> slotStorage;
+  bool useRseq = false;
+
+  static size_t getNumCpus() noexcept {
+#ifdef __linux__
+    auto ret = ::sysconf(_SC_NPROCESSORS_CONF);
+    if (ret > 0)
+      return ret;
+#endif
+    return 1;
+  }
+
+  CpuCache &currentCache() noexcept {
+#ifdef __linux__
+    auto cpu = ::sched_getcpu();
+    if (__builtin_expect(cpu >= 0, true))
+      return caches[size_t(cpu) % numCaches];
+#endif
+    static std::atomic_size_t nextCache{0};
+    thread_local size_t threadCache =
+        nextCache.fetch_add(1, std::memory_order_relaxed);
+    return caches[threadCache % numCaches];
+  }
+
+  /// Returns true, iff objects with \p Id are cached per CPU
+  bool isCached(UserAllocatorId Id) const noexcept {
+    return Id < MaxCachedIds && caches[0].bins[Id].slots;
+  }
+
+  /// Pops an object with \p Id from the cache of the current CPU, if any
+  void *pop(UserAllocatorId Id) noexcept {
+#ifdef MEM_HAVE_RSEQ
+    if (__builtin_expect(useRseq, true))
+      return detail::rseqPop(detail::currentRseq(),
+                             reinterpret_cast<char *>(&caches[0].bins[Id]),
+                             sizeof(CpuCache), numCaches);
+#endif
+    auto &cache = currentCache();
+    std::lock_guard<std::mutex> lck(cache.mtx);
+    auto &bin = cache.bins[Id];
+    return bin.count ? bin.slots[--bin.count] : nullptr;
+  }
+
+  /// \brief Pushes \p Obj onto the cache of the current CPU. Returns false, if
+  /// it is full.
+  bool push(void *Obj, UserAllocatorId Id) noexcept {
+#ifdef MEM_HAVE_RSEQ
+    if (__builtin_expect(useRseq, true))
+      return detail::rseqPush(detail::currentRseq(),
+                              reinterpret_cast<char *>(&caches[0].bins[Id]),
+                              sizeof(CpuCache), numCaches, Obj, cacheCapacity);
+#endif
+    auto &cache = currentCache();
+    std::lock_guard<std::mutex> lck(cache.mtx);
+    auto &bin = cache.bins[Id];
+    if (bin.count == cacheCapacity)
+      return false;
+    bin.slots[bin.count++] = Obj;
+    return true;
+  }
+
+  /// Takes up to half of the capacity from the central driver. If the central
+  /// driver runs out of memory, returns the objects allocated so far, if any.
+  Batch takeBatch(UserAllocatorId Id) {
+    const auto batchSize = std::max<size_t>(1, cacheCapacity / 2);
+    Batch ret;
+    std::lock_guard<std::mutex> lck(centralMtx);
+    try {
+      while (ret.count < batchSize)
+        ret.add(central.allocate(Id));
+    } catch (...) {
+      if (!ret.count)
+        throw;
+    }
+    return ret;
+  }
+
+  /// Gives all objects of \p B back to the central driver
+  void returnBatch(Batch B, UserAllocatorId Id) noexcept {
+    std::lock_guard<std::mutex> lck(centralMtx);
+    while (B.head) {
+      auto *obj = B.head;
+      B.head = *static_cast<void **>(obj);
+      central.deallocate(obj, Id);
+    }
+  }
+
+public:
+  /// \param CacheCapacity The largest number of freed objects per size-class
+  /// that each CPU keeps
+  explicit PerCpuAllocatorDriver(size_t CacheCapacity = DefaultCacheCapacity)
+      : caches(new CpuCache[getNumCpus()]), numCaches(getNumCpus()),
+        cacheCapacity(std::max<size_t>(1, CacheCapacity)) {
+#ifdef MEM_HAVE_RSEQ
+    useRseq = detail::rseqAvailable();
+#endif
+  }
+
+  /// Same as PerCpuAllocatorDriver(size_t), but configures the central driver
+  /// at runtime
+  explicit PerCpuAllocatorDriver(const PoolConfig &Config,
+                                 size_t CacheCapacity = DefaultCacheCapacity)
+      : central(Config), caches(new CpuCache[getNumCpus()]),
+        numCaches(getNumCpus()),
+        cacheCapacity(std::max<size_t>(1, CacheCapacity)) {
+#ifdef MEM_HAVE_RSEQ
+    useRseq = detail::rseqAvailable();
+#endif
+  }
+
+  PerCpuAllocatorDriver(const PerCpuAllocatorDriver &) = delete;
+  PerCpuAllocatorDriver &operator=(const PerCpuAllocatorDriver &) = delete;
+
+  /// See SubtypeAllocatorDriver::getId()
+  template <typename T> UserAllocatorId getId() {
+    return getId(sizeof(T), alignof(T));
+  }
+
+  /// \brief See SubtypeAllocatorDriver::getId(). Objects must be (de-)allocated
+  /// with the Ids from here, not from getDriver().
+  UserAllocatorId getId(size_t ObjectSize, size_t ObjectAlignment) {
+    std::lock_guard<std::mutex> lck(centralMtx);
+    auto id = central.getId(ObjectSize, ObjectAlignment);
+    if (id < MaxCachedIds && !caches[0].bins[id].slots) {
+      std::unique_ptr<void *[]> slots(new void *[numCaches * cacheCapacity]);
+      slotStorage.push_back(std::move(slots));
+      for (size_t i = 0; i < numCaches; ++i)
+        caches[i].bins[id].slots = slotStorage.back().get() + i * cacheCapacity;
+    }
+    return id;
+  }
+
+  /// \brief Allocates an object with \p Id from the cache of the current CPU.
+  /// Takes a batch of objects from the central driver, if the cache is empty.
+  void *allocate(UserAllocatorId Id) {
+    if (__builtin_expect(!isCached(Id), false)) {
+      std::lock_guard<std::mutex> lck(centralMtx);
+      return central.allocate(Id);
+    }
+    if (auto *ret = pop(Id))
+      return ret;
+
+    auto batch = takeBatch(Id);
+    auto *ret = batch.head;
+    batch.head = *static_cast<void **>(ret);
+    // The rest goes to the cache of the CPU we are running on now. Objects
+    // that do not fit, since other threads refilled it in the meantime, go
+    // back.
+    Batch excess;
+    while (batch.head) {
+      auto *obj = batch.head;
+      batch.head = *static_cast<void **>(obj);
+      if (!push(obj, Id))
+        excess.add(obj);
+    }
+    if (excess.head)
+      returnBatch(excess, Id);
+    return ret;
+  }
+
+  /// \brief Deallocates \p Obj into the cache of the current CPU, which need
+  /// not be the one it has been allocated from. Gives half of the cached
+  /// objects back to the central driver, if the cache is full.
+  void deallocate(void *Obj, UserAllocatorId Id) noexcept {
+    if (__builtin_expect(!isCached(Id), false)) {
+      std::lock_guard<std::mutex> lck(centralMtx);
+      central.deallocate(Obj, Id);
+      return;
+    }
+    if (__builtin_expect(push(Obj, Id), true))
+      return;
+
+    Batch excess;
+    for (size_t i = cacheCapacity / 2; i; --i) {
+      auto *obj = pop(Id);
+      if (!obj)
+        break;
+      excess.add(obj);
+    }
+    if (!push(Obj, Id))
+      excess.add(Obj);
+    returnBatch(excess, Id);
+  }
+
+  /// \brief Returns true, iff the caches are accessed with restartable
+  /// sequences rather than under a mutex per cache
+  bool usesRseq() const noexcept { return useRseq; }
+
+  /// Returns the number of per-CPU caches
+  size_t getNumCaches() const noexcept { return numCaches; }
+
+  /// \brief Returns the number of freed objects with \p Id that are currently
+  /// parked in the per-CPU caches. Must not be called concurrently with
+  /// (de-)allocations.
+  size_t getNumCached(UserAllocatorId Id) const noexcept {
+    size_t ret = 0;
+    if (Id >= MaxCachedIds)
+      return 0;
+    for (size_t i = 0; i < numCaches; ++i)
+      ret += caches[i].bins[Id].count;
+    return ret;
+  }
+
+  /// \brief Provides access to the central SubtypeAllocatorDriver, e.g. for
+  /// its statistics. Must not be used concurrently with (de-)allocations.
+  SubtypeAllocatorDriver<AllocationBlockSize> &getDriver() noexcept {
+    return central;
+  }
+};
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+
+namespace mem {
+
+template <typename T> class refc;
+
+/// \brief Declares whether the objects of type \p T may be copied with \c
+/// memcpy by RefcFactory::clone_all(), when ignoring their refc members (see
+/// refc_members).
+///
+/// Holds for trivially copyable types. Specialize it for types whose only
+/// non-trivial members are refcs. Types that own other resources, e.g. a \c
+/// std::string or \c std::vector, are never trivially relocatable, since both
+/// copies would release the same resource.
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+/// \brief The refc members of \p T that RefcFactory::clone_all() redirects to
+/// the copied objects, as a tuple of member-pointers in \c value. All other
+/// members are copied bitwise. Specialize it for every type with refc
+/// members, e.g.
+/// \code
+/// template <> struct mem::refc_members<Node> {
+///   static constexpr auto value = std::make_tuple(&Node::left, &Node::right);
+/// };
+/// \endcode
+template <typename T> struct refc_members {
+  static constexpr std::tuple<> value{};
+};
+
+namespace detail {
+template <typename T> struct is_refc : std::false_type {};
+template <typename T> struct is_refc<refc<T>> : std::true_type {};
+} // namespace detail
+
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace mem {
+
+template <typename T> class refc;
+
+/// \brief Maps addresses inside the blocks of a SubtypeAllocatorDriver to the
+/// corresponding addresses in a clone of it. See
+/// SubtypeAllocatorDriver::cloneInto() and RefcFactory::clone_all().
+class RelocationTable {
+  struct Range {
+    const char *oldBegin;
+    const char *oldEnd;
+    char *newBegin;
+    size_t objectSize;
+
+    friend bool operator<(const Range &R1, const Range &R2) noexcept {
+      return R1.oldBegin < R2.oldBegin;
+    }
+  };
+
+  std::vector<Range> ranges;
+
+public:
+  explicit RelocationTable() noexcept = default;
+
+  /// \brief Records that the \p NumBytes bytes starting at \p OldBegin have
+  /// been copied to \p NewBegin. The range consists of objects of \p
+  /// ObjectSize bytes each.
+  void add(const void *OldBegin, size_t NumBytes, void *NewBegin,
+           size_t ObjectSize) {
+    auto oldBegin = static_cast<const char *>(OldBegin);
+    ranges.push_back({oldBegin, oldBegin + NumBytes,
+                      static_cast<char *>(NewBegin), ObjectSize});
+  }
+
+  /// Must be called after the last add() and before the first relocate()
+  void finalize() { std::sort(ranges.begin(), ranges.end()); }
+
+  /// \brief Translates \p Ptr into the clone.
+  /// \param[out] IsObjectStart Set to \c true, iff \p Ptr points to the start
+  /// of an object
+  /// \returns The relocated pointer, or \c nullptr if \p Ptr does not point
+  /// into any of the copied ranges
+  void *relocate(const void *Ptr, bool &IsObjectStart) const noexcept {
+    auto ptr = static_cast<const char *>(Ptr);
+    auto it = std::upper_bound(
+        ranges.begin(), ranges.end(), ptr,
+        [](const char *P, const Range &R) { return P < R.oldBegin; });
+    if (it == ranges.begin() || ptr >= (--it)->oldEnd) {
+      IsObjectStart = false;
+      return nullptr;
+    }
+
+    const size_t offset = ptr - it->oldBegin;
+    IsObjectStart = offset % it->objectSize == 0;
+    return it->newBegin + offset;
+  }
+
+  /// \brief Translates \p Ptr into the clone.
+  /// \returns The relocated pointer, or \c nullptr if \p Ptr does not point
+  /// into any of the copied ranges
+  void *relocate(const void *Ptr) const noexcept {
+    bool isObjectStart;
+    return relocate(Ptr, isObjectStart);
+  }
+
+  /// \brief Translates a refc \p Rc that points into the original
+  /// RefcFactory into a new reference to the corresponding object in the
+  /// clone. refcs that do not point into the original factory, e.g.
+  /// singletons, are copied unchanged.
+  template <typename T> refc<T> relocate(const refc<T> &Rc) const noexcept {
+    using one_allocation = typename refc<T>::one_allocation;
+
+    if (!Rc)
+      return Rc;
+    if (auto *nw = relocate(Rc.Data))
+      return refc<T>(static_cast<one_allocation *>(nw), std::true_type{});
+    return Rc;
+  }
+
+  /// Checks whether this table does not contain any ranges
+  bool empty() const noexcept { return ranges.empty(); }
+};
+} // namespace mem
\ No newline at end of file
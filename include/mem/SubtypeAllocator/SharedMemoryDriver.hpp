@@ -0,0 +1,485 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mem {
+
+template <typename T> class shm_refc;
+
+namespace detail {
+
+/// \brief The layout of a shared memory segment used by SharedMemoryDriver.
+///
+/// All links inside the segment are offsets from its start, such that every
+/// process can map it at a different address. The free-lists are lock-free
+/// Treiber-stacks whose heads carry an ABA-tag in their upper bits.
+struct SharedMemorySegment {
+  static constexpr uint64_t Magic = 0x31306d68736d656d; // "memshm01"
+  static constexpr size_t MaxClasses = 64;
+  static constexpr unsigned TagShift = 40;
+  static constexpr uint64_t OffsetMask = (uint64_t(1) << TagShift) - 1;
+
+  struct SizeClass {
+    std::atomic<uint64_t> freeList;
+    uint64_t objectSize;
+    uint64_t objectAlignment;
+  };
+
+  /// Written last by the creator, see SharedMemoryDriver::attachSegment()
+  std::atomic<uint64_t> magic;
+  uint64_t size;
+  std::atomic<uint64_t> bump;
+  std::atomic<uint64_t> root;
+  std::atomic<uint32_t> lock;
+  std::atomic<uint32_t> numClasses;
+  SizeClass classes[MaxClasses];
+
+  char *base() noexcept { return reinterpret_cast<char *>(this); }
+
+  uint64_t offsetOf(const void *Ptr) noexcept {
+    return static_cast<const char *>(Ptr) - base();
+  }
+
+  static std::atomic<uint64_t> &link(void *Chunk) noexcept {
+    return *reinterpret_cast<std::atomic<uint64_t> *>(Chunk);
+  }
+
+  void *allocate(uint32_t Id) {
+    auto &cls = classes[Id];
+    auto head = cls.freeList.load(std::memory_order_acquire);
+    while (head & OffsetMask) {
+      auto *chunk = base() + (head & OffsetMask);
+      auto next = link(chunk).load(std::memory_order_relaxed);
+      auto nwHead = next | (((head >> TagShift) + 1) << TagShift);
+      if (cls.freeList.compare_exchange_weak(head, nwHead,
+                                             std::memory_order_acquire))
+        return chunk;
+    }
+
+    const auto osize = cls.objectSize;
+    const auto oalign = cls.objectAlignment;
+    auto pos = bump.load(std::memory_order_relaxed);
+    uint64_t start;
+    do {
+      start = (pos + oalign - 1) & ~(oalign - 1);
+      if (start + osize > size || start + osize > OffsetMask)
+        throw std::bad_alloc();
+    } while (!bump.compare_exchange_weak(pos, start + osize,
+                                         std::memory_order_relaxed));
+
+    return base() + start;
+  }
+
+  void deallocate(void *Chunk, uint32_t Id) noexcept {
+    auto &cls = classes[Id];
+    const auto offset = offsetOf(Chunk);
+    auto head = cls.freeList.load(std::memory_order_relaxed);
+    uint64_t nwHead;
+    do {
+      link(Chunk).store(head & OffsetMask, std::memory_order_relaxed);
+      nwHead = offset | (((head >> TagShift) + 1) << TagShift);
+    } while (!cls.freeList.compare_exchange_weak(head, nwHead,
+                                                 std::memory_order_release));
+  }
+
+  uint32_t getId(size_t ObjectSize, size_t ObjectAlignment) {
+    // Free chunks hold an atomic link
+    ObjectAlignment = std::max(ObjectAlignment, alignof(uint64_t));
+    const auto normalizedSize =
+        (std::max(sizeof(uint64_t), ObjectSize) + ObjectAlignment - 1) &
+        ~(ObjectAlignment - 1);
+
+    auto find = [&](uint32_t Num) {
+      uint32_t id = 0;
+      for (; id < Num; ++id) {
+        if (classes[id].objectSize == normalizedSize &&
+            classes[id].objectAlignment == ObjectAlignment)
+          break;
+      }
+      return id;
+    };
+
+    // Size-classes are never changed once published, so looking up an
+    // existing one does not need the lock
+    auto num = numClasses.load(std::memory_order_acquire);
+    if (auto id = find(num); id != num)
+      return id;
+
+    while (lock.exchange(1, std::memory_order_acquire))
+      std::this_thread::yield();
+
+    num = numClasses.load(std::memory_order_relaxed);
+    const auto id = find(num);
+
+    if (id == num) {
+      if (num == MaxClasses) {
+        lock.store(0, std::memory_order_release);
+        throw std::bad_alloc();
+      }
+      classes[id].objectSize = normalizedSize;
+      classes[id].objectAlignment = ObjectAlignment;
+      numClasses.store(num + 1, std::memory_order_release);
+    }
+
+    lock.store(0, std::memory_order_release);
+    return id;
+  }
+};
+
+/// The control-block that precedes every object managed by shm_refc. It is
+/// located in shared memory, so instead of a pointer to its driver it stores
+/// its own offset inside the segment.
+struct shm_counter {
+  std::atomic<uint64_t> Ctr;
+  uint64_t Offset;
+  uint32_t Id;
+
+  SharedMemorySegment *segment() noexcept {
+    return reinterpret_cast<SharedMemorySegment *>(
+        reinterpret_cast<char *>(this) - Offset);
+  }
+};
+
+} // namespace detail
+
+/// \brief A memory-pool inside a shared memory segment that multiple processes
+/// can allocate from and deallocate to concurrently.
+///
+/// The segment has a fixed size given at creation. Each process maps the
+/// segment at its own address; all internal links are therefore stored as
+/// offsets. Objects are managed by shm_refc, an offset-based variant of refc.
+/// Types allocated with this driver must be position-independent, i.e. must
+/// not contain raw pointers or virtual functions (unless all processes are
+/// forked from the same parent), but may contain shm_refc members.
+class SharedMemoryDriver {
+  detail::SharedMemorySegment *Segment = nullptr;
+  size_t Size = 0;
+  int Fd = -1;
+  /// Identifies this driver in the per-type Id caches of getId()
+  uint32_t Serial = nextSerial();
+
+  static uint32_t nextSerial() noexcept {
+    static std::atomic<uint32_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  [[noreturn]] static void fail(const char *What) {
+    throw std::system_error(errno, std::generic_category(), What);
+  }
+
+  void map(size_t NumBytes) {
+    auto *mem =
+        ::mmap(nullptr, NumBytes, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+    if (mem == MAP_FAILED)
+      fail("mmap");
+    Segment = static_cast<detail::SharedMemorySegment *>(mem);
+    Size = NumBytes;
+  }
+
+  void initialize(size_t NumBytes) {
+    if (::ftruncate(Fd, NumBytes))
+      fail("ftruncate");
+    map(NumBytes);
+
+    // The new pages are zero-filled, so the free-lists are already empty
+    Segment->size = NumBytes;
+    Segment->bump.store(sizeof(detail::SharedMemorySegment),
+                        std::memory_order_relaxed);
+    Segment->magic.store(detail::SharedMemorySegment::Magic,
+                         std::memory_order_release);
+  }
+
+  explicit SharedMemoryDriver() noexcept = default;
+
+  /// \brief Maps the segment of Fd. A named segment may still be being
+  /// initialized by its creator, so waits up to AttachTimeout for its size
+  /// and magic number to appear.
+  void attachSegment() {
+    const auto deadline = std::chrono::steady_clock::now() + AttachTimeout;
+    auto waitOrFail = [&] {
+      if (std::chrono::steady_clock::now() > deadline) {
+        errno = EINVAL;
+        fail("Not a SharedMemoryDriver segment");
+      }
+      std::this_thread::yield();
+    };
+
+    struct stat st;
+    while (true) {
+      if (::fstat(Fd, &st))
+        fail("fstat");
+      if (size_t(st.st_size) >= sizeof(detail::SharedMemorySegment))
+        break;
+      waitOrFail();
+    }
+
+    map(st.st_size);
+    while (Segment->magic.load(std::memory_order_acquire) !=
+           detail::SharedMemorySegment::Magic)
+      waitOrFail();
+  }
+
+public:
+  using UserAllocatorId = uint32_t;
+
+  /// How long attaching to a named segment waits for its creator to
+  /// initialize it
+  static constexpr std::chrono::seconds AttachTimeout{1};
+
+  /// \brief Creates a new anonymous segment of \p NumBytes bytes (using \c
+  /// memfd_create). Other processes can use it after \c fork() or attach to
+  /// it via the file-descriptor getFd().
+  explicit SharedMemoryDriver(size_t NumBytes) {
+    Fd = ::memfd_create("mem-pool", MFD_CLOEXEC);
+    if (Fd < 0)
+      fail("memfd_create");
+    initialize(NumBytes);
+  }
+
+  /// \brief Creates the named segment \p Name of \p NumBytes bytes (using \c
+  /// shm_open), or attaches to it, if it already exists.
+  SharedMemoryDriver(const char *Name, size_t NumBytes) {
+    Fd = ::shm_open(Name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (Fd >= 0) {
+      initialize(NumBytes);
+      return;
+    }
+    if (errno != EEXIST)
+      fail("shm_open");
+
+    Fd = ::shm_open(Name, O_RDWR, 0600);
+    if (Fd < 0)
+      fail("shm_open");
+    attachSegment();
+  }
+
+  /// \brief Attaches to the existing segment referred to by \p SegmentFd,
+  /// e.g. a duplicate of getFd() from another process. Takes ownership of \p
+  /// SegmentFd.
+  static SharedMemoryDriver attach(int SegmentFd) {
+    SharedMemoryDriver ret;
+    ret.Fd = SegmentFd;
+    ret.attachSegment();
+    return ret;
+  }
+
+  SharedMemoryDriver(const SharedMemoryDriver &) = delete;
+  SharedMemoryDriver(SharedMemoryDriver &&Other) noexcept
+      : Segment(std::exchange(Other.Segment, nullptr)), Size(Other.Size),
+        Fd(std::exchange(Other.Fd, -1)), Serial(Other.Serial) {}
+
+  /// Unmaps the segment from this process. The segment itself is kept alive
+  /// as long as another process maps it.
+  ~SharedMemoryDriver() {
+    if (Segment)
+      ::munmap(Segment, Size);
+    if (Fd >= 0)
+      ::close(Fd);
+  }
+
+  /// Removes the named segment \p Name; it is freed after the last process
+  /// has unmapped it.
+  static void unlink(const char *Name) noexcept { ::shm_unlink(Name); }
+
+  /// Returns the file-descriptor of the shared memory segment
+  int getFd() const noexcept { return Fd; }
+
+  /// \brief Computes the size-class ID for objects of type \p T. Size-classes
+  /// are shared between all processes using the segment.
+  ///
+  /// The Id is cached per type for the driver that has used it last, so
+  /// repeated calls (e.g. from create()) take neither the segment's lock nor
+  /// a look-up.
+  template <typename T> UserAllocatorId getId() {
+    static std::atomic<uint64_t> cache{0};
+    const auto cached = cache.load(std::memory_order_acquire);
+    if (__builtin_expect((cached >> 32) == Serial, true))
+      return static_cast<UserAllocatorId>(cached);
+
+    const auto id = Segment->getId(sizeof(T), alignof(T));
+    cache.store(uint64_t(Serial) << 32 | id, std::memory_order_release);
+    return id;
+  }
+
+  /// Allocates an uninitialized chunk of memory for an object with \p Id.
+  /// Throws \c std::bad_alloc, if the segment is exhausted.
+  void *allocate(UserAllocatorId Id) { return Segment->allocate(Id); }
+
+  /// Deallocates \p Obj that has been allocated with \p Id (possibly by a
+  /// different process)
+  void deallocate(void *Obj, UserAllocatorId Id) noexcept {
+    Segment->deallocate(Obj, Id);
+  }
+
+  /// \brief Creates an object of type \p U in shared memory and forwards the
+  /// arguments \p args to \p U's constructor.
+  template <typename U, typename... Args> shm_refc<U> create(Args &&... args);
+
+  /// \brief Publishes \p Root, such that other processes can find it with
+  /// getRoot(). Keeps a reference to \p Root.
+  template <typename U> void setRoot(const shm_refc<U> &Root);
+
+  /// \brief Returns the root object published with setRoot(), or \c nullptr.
+  /// Note: The root must not be replaced concurrently.
+  template <typename U> shm_refc<U> getRoot();
+};
+
+/// \brief An offset-based variant of refc for objects in a SharedMemoryDriver.
+///
+/// A shm_refc stores the distance between itself and the control-block of its
+/// pointee. It therefore stays valid when it is part of an object in shared
+/// memory that is mapped at different addresses in different processes.
+template <typename T> class shm_refc final {
+  using counter = detail::shm_counter;
+
+  // Distance from this to the control-block; 0 means nullptr, since a
+  // shm_refc can never be located at its pointee's control-block
+  std::ptrdiff_t Off = 0;
+
+  friend class SharedMemoryDriver;
+
+  counter *ctr() const noexcept {
+    return Off ? reinterpret_cast<counter *>(
+                     reinterpret_cast<char *>(const_cast<shm_refc *>(this)) +
+                     Off)
+               : nullptr;
+  }
+
+  void set(counter *Ctr) noexcept {
+    Off = Ctr ? reinterpret_cast<char *>(Ctr) - reinterpret_cast<char *>(this)
+              : 0;
+  }
+
+  void release() noexcept {
+    auto *dat = ctr();
+    if (!dat)
+      return;
+    Off = 0;
+
+    if (dat->Ctr.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      reinterpret_cast<T *>(&static_cast<one_allocation *>(dat)->Data)->~T();
+      dat->segment()->deallocate(dat, dat->Id);
+    }
+  }
+
+public:
+  // For internal use only
+  struct one_allocation : public counter {
+    std::aligned_storage_t<sizeof(T), alignof(T)> Data;
+  };
+
+  shm_refc(std::nullptr_t = nullptr) noexcept {}
+
+  /// Copy constructor. Increments the reference-counter by one.
+  shm_refc(const shm_refc &Other) noexcept {
+    auto *dat = Other.ctr();
+    if (dat)
+      dat->Ctr.fetch_add(1, std::memory_order_relaxed);
+    set(dat);
+  }
+
+  /// Move constructor. Leaves \p Other in \c nullptr state.
+  shm_refc(shm_refc &&Other) noexcept {
+    set(Other.ctr());
+    Other.Off = 0;
+  }
+
+  shm_refc &operator=(shm_refc Other) noexcept {
+    auto *mine = ctr();
+    set(Other.ctr());
+    Other.set(mine);
+    return *this;
+  }
+
+  /// Destructor. Decrements the reference-counter by one and destroys the
+  /// pointee, if it reaches \c 0.
+  ~shm_refc() { release(); }
+
+  T *get() const noexcept {
+    auto *dat = ctr();
+    return dat ? reinterpret_cast<T *>(
+                     &static_cast<one_allocation *>(dat)->Data)
+               : nullptr;
+  }
+  T *operator->() const noexcept { return get(); }
+  T &operator*() const noexcept { return *get(); }
+
+  explicit operator bool() const noexcept { return Off; }
+
+  size_t use_count() const noexcept {
+    auto *dat = ctr();
+    return dat ? dat->Ctr.load(std::memory_order_acquire) : 0;
+  }
+
+  bool operator==(const shm_refc &Other) const noexcept {
+    return ctr() == Other.ctr();
+  }
+  bool operator!=(const shm_refc &Other) const noexcept {
+    return !(*this == Other);
+  }
+};
+
+template <typename U, typename... Args>
+shm_refc<U> SharedMemoryDriver::create(Args &&... args) {
+  using one_allocation = typename shm_refc<U>::one_allocation;
+
+  const auto id = getId<one_allocation>();
+  auto *mem = static_cast<one_allocation *>(allocate(id));
+  try {
+    new (&mem->Data) U(std::forward<Args>(args)...);
+  } catch (...) {
+    deallocate(mem, id);
+    throw;
+  }
+
+  mem->Ctr.store(1, std::memory_order_relaxed);
+  mem->Offset = Segment->offsetOf(mem);
+  mem->Id = id;
+
+  shm_refc<U> ret;
+  ret.set(mem);
+  return ret;
+}
+
+template <typename U>
+void SharedMemoryDriver::setRoot(const shm_refc<U> &Root) {
+  auto *dat = Root.ctr();
+  if (dat)
+    dat->Ctr.fetch_add(1, std::memory_order_relaxed);
+
+  auto old = Segment->root.exchange(dat ? Segment->offsetOf(dat) : 0,
+                                    std::memory_order_acq_rel);
+  if (old) {
+    shm_refc<U> prev;
+    prev.set(reinterpret_cast<detail::shm_counter *>(Segment->base() + old));
+  }
+}
+
+template <typename U> shm_refc<U> SharedMemoryDriver::getRoot() {
+  auto offset = Segment->root.load(std::memory_order_acquire);
+  if (!offset)
+    return nullptr;
+
+  auto *dat = reinterpret_cast<detail::shm_counter *>(Segment->base() + offset);
+  dat->Ctr.fetch_add(1, std::memory_order_relaxed);
+  shm_refc<U> ret;
+  ret.set(dat);
+  return ret;
+}
+
+} // namespace mem
\ No newline at end of file
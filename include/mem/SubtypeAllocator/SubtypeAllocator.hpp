@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <new>
 #include <type_traits> //aligned_storage
 
 #include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
@@ -19,6 +21,8 @@ class SubtypeAllocator
   template <typename U>
   static constexpr size_t normalized_size_v =
       SubtypeAllocatorDriver<AllocationBlockSize>::template normalizedSize<U>();
+  static constexpr auto InvalidId =
+      SubtypeAllocatorDriver<AllocationBlockSize>::InvalidId;
 
 public:
   SubtypeAllocator(SubtypeAllocatorDriver<AllocationBlockSize> *Driver) noexcept
@@ -35,7 +39,7 @@ public:
             Other.Driver, normalized_size_v<U> == normalized_size_v<T> &&
                                   alignof(U) == alignof(T)
                               ? Other.Id
-                              : -1) {
+                              : InvalidId) {
 
     // std::cerr << "Rebind allocator with id " << Other.Id << "\n";
   }
@@ -52,7 +56,13 @@ public:
     using other = SubtypeAllocator<U, AllocationBlockSize>;
   };
 
-  pointer allocate(size_t N) {
+  pointer allocate(size_t N) { return allocateImpl(N); }
+  void deallocate(pointer Ptr, size_t N) { deallocateImpl(Ptr, N); }
+
+protected:
+  /// Allocates \p N objects. Single objects are pooled in the driver and
+  /// attributed to \p Tag, if given.
+  template <typename... TagT> pointer allocateImpl(size_t N, TagT... Tag) {
     if (N != 1) {
       // cannot allocate arrays, since the Blocks are not contiguous
       // in memory. So, fallback to the default allocator
@@ -61,14 +71,16 @@ public:
     }
 
     auto id = this->Id;
-    if (id == -1) {
+    if (id == InvalidId) {
       this->Id = id = this->Driver->template getId<T>();
     }
 
-    return reinterpret_cast<pointer>(this->Driver->allocate(id));
+    return reinterpret_cast<pointer>(this->Driver->allocate(id, Tag...));
   }
 
-  void deallocate(pointer Ptr, size_t N) {
+  /// Counterpart of allocateImpl()
+  template <typename... TagT>
+  void deallocateImpl(pointer Ptr, size_t N, TagT... Tag) {
     if (N != 1) {
       ::delete[] reinterpret_cast<
           std::aligned_storage_t<sizeof(T), alignof(T)> *>(Ptr);
@@ -76,12 +88,111 @@ public:
     }
 
     auto id = this->Id;
-    if (id == -1) {
+    if (id == InvalidId) {
       this->Id = id = this->Driver->template getId<T>();
     }
 
-    this->Driver->deallocate(Ptr, id);
+    this->Driver->deallocate(Ptr, id, Tag...);
   }
 };
 
+/// \brief Same as SubtypeAllocator, but additionally carries an \c
+/// AllocationTag that attributes all objects allocated through it (and its
+/// rebound copies) to a subsystem. The live bytes per tag can be queried with
+/// SubtypeAllocatorDriver::getLiveBytes(). Arrays are not pooled and therefore
+/// not accounted.
+///
+/// \tparam T The type of objects this allocator should allocate
+/// \tparam AllocationBlockSize The \c AllocationBlockSize used in the wrapped
+/// SubtypeAllocatorDriver
+template <typename T, size_t AllocationBlockSize = 1024>
+class TaggedSubtypeAllocator : public SubtypeAllocator<T, AllocationBlockSize> {
+  using Base = SubtypeAllocator<T, AllocationBlockSize>;
+
+public:
+  using AllocationTag =
+      typename SubtypeAllocatorDriver<AllocationBlockSize>::AllocationTag;
+  using typename Base::pointer;
+
+  AllocationTag Tag;
+
+  TaggedSubtypeAllocator(SubtypeAllocatorDriver<AllocationBlockSize> *Driver,
+                         AllocationTag Tag) noexcept
+      : Base(Driver), Tag(Tag) {}
+  TaggedSubtypeAllocator(const TaggedSubtypeAllocator &Other) noexcept
+      : Base(Other), Tag(Other.Tag) {}
+  template <typename U>
+  TaggedSubtypeAllocator(
+      const TaggedSubtypeAllocator<U, AllocationBlockSize> &Other) noexcept
+      : Base(static_cast<const SubtypeAllocator<U, AllocationBlockSize> &>(
+            Other)),
+        Tag(Other.Tag) {}
+
+  template <typename U> struct rebind {
+    using other = TaggedSubtypeAllocator<U, AllocationBlockSize>;
+  };
+
+  pointer allocate(size_t N) { return this->allocateImpl(N, Tag); }
+  void deallocate(pointer Ptr, size_t N) {
+    this->deallocateImpl(Ptr, N, Tag);
+  }
+
+  friend bool operator==(const TaggedSubtypeAllocator &PMA1,
+                         const TaggedSubtypeAllocator &PMA2) noexcept {
+    return PMA1.Driver == PMA2.Driver && PMA1.Id == PMA2.Id &&
+           PMA1.Tag == PMA2.Tag;
+  }
+  friend bool operator!=(const TaggedSubtypeAllocator &PMA1,
+                         const TaggedSubtypeAllocator &PMA2) noexcept {
+    return !(PMA1 == PMA2);
+  }
+};
+
+namespace detail {
+template <typename Alloc> struct is_subtype_allocator : std::false_type {};
+template <typename T, size_t AllocationBlockSize>
+struct is_subtype_allocator<SubtypeAllocator<T, AllocationBlockSize>>
+    : std::true_type {};
+template <typename T, size_t AllocationBlockSize>
+struct is_subtype_allocator<TaggedSubtypeAllocator<T, AllocationBlockSize>>
+    : std::true_type {};
+} // namespace detail
+
+/// Tag type for explicitly discarding containers whose elements are not
+/// trivially destructible. See discard().
+struct unsafe_discard_t {
+  explicit unsafe_discard_t() = default;
+};
+inline constexpr unsafe_discard_t unsafe_discard{};
+
+/// \brief Same as discard(Container&), but also accepts elements that are not
+/// trivially destructible. Their destructors are skipped, so this must only be
+/// used if the program does not depend on their side-effects.
+template <typename Container> void discard(Container &C, unsafe_discard_t) {
+  static_assert(
+      detail::is_subtype_allocator<typename Container::allocator_type>::value,
+      "Only containers using a SubtypeAllocator or TaggedSubtypeAllocator can "
+      "be discarded; with any other allocator the nodes would be leaked");
+  auto alloc = C.get_allocator();
+  // Intentionally does not call the destructor of C that would visit all nodes
+  ::new (static_cast<void *>(std::addressof(C))) Container(std::move(alloc));
+}
+
+/// \brief Leaves the node-based container \p C (e.g. \c std::list, \c
+/// std::set or \c std::map) empty in constant time without destroying and
+/// deallocating its nodes one by one.
+///
+/// \p C must use a SubtypeAllocator or TaggedSubtypeAllocator (checked at
+/// compile time). Its nodes stay allocated in the SubtypeAllocatorDriver,
+/// until the driver is destroyed or SubtypeAllocatorDriver::release() drops
+/// all of its blocks at once. Anything that \p C allocates as array, e.g. the
+/// buckets of an \c std::unordered_set, is leaked.
+template <typename Container> void discard(Container &C) {
+  static_assert(
+      std::is_trivially_destructible_v<typename Container::value_type>,
+      "Discarding would skip the destructors of the elements; use "
+      "discard(C, unsafe_discard) to do so anyway");
+  discard(C, unsafe_discard);
+}
+
 } // namespace mem
\ No newline at end of file
@@ -1,7 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <optional>
+#include <unordered_set>
 
+#include "mem/PoolConfig.hpp"
+#include "mem/Probes.hpp"
+#include "mem/SubtypeAllocator/BlockCache.hpp"
+#include "mem/SubtypeAllocator/Lifetime.hpp"
+#include "mem/SubtypeAllocator/RelocationTable.hpp"
 #include "mem/SubtypeAllocator/detail/SubtypeAllocatorDriverBase.hpp"
 
 namespace mem {
@@ -16,56 +30,403 @@ namespace mem {
 /// SubtypeAllocator instead and pass a pointer to a SubtypeAllocatorDriver to
 /// its constructor.
 ///
+/// Large objects do not blow up the blocks: A block holds at most as many
+/// objects as fit into MaxBlockBytes (but at least one), and objects of at
+/// least DirectThreshold bytes are not pooled at all. They are allocated one by
+/// one and returned to the system when being deallocated.
+///
+/// These limits, as well as the block size and its growth, can be configured
+/// at runtime with a PoolConfig, e.g. from environment variables.
+///
+/// A driver can be the child of a (thread-safe) BlockCache that lends the
+/// blocks to it, such that short-lived drivers do not allocate any memory
+/// from the system at steady state.
+///
 /// \tparam AllocationBlockSize The number of object to allocate at once. The
 /// default is 1024
 template <size_t AllocationBlockSize = 1024>
 class SubtypeAllocatorDriver : public detail::SubtypeAllocatorDriverBase {
-  struct Block : public BlockBase {
-    char data[0];
+  PoolConfig poolConfig;
+  /// The parent of this driver that lends the blocks, if any
+  BlockCache *parent = nullptr;
+  /// Empty blocks of PoolConfig::uniformBlockBytes bytes that have left their
+  /// size-class, see reclaimEmptyBlocks()
+  std::vector<BlockInfo> emptyBlocks;
+
+  /// Returns the alignment of the memory of a block. Blocks with fundamental
+  /// alignment are interchangeable.
+  static constexpr size_t memAlignment(size_t ObjectAlignment) noexcept {
+    return std::max(ObjectAlignment, alignof(std::max_align_t));
+  }
+
+  /// Returns the page size that a block of \p NumBytes bytes is sized and
+  /// aligned to, if PoolConfig::pageExactBlocks is set
+  static constexpr size_t pageGranularity(size_t NumBytes) noexcept {
+    return NumBytes >= HugePageSize ? HugePageSize : PageSize;
+  }
+
+  /// Returns the number of bytes of a block for \p NumObjects objects
+  size_t blockBytes(size_t ObjectSize, size_t NumObjects) const noexcept {
+    const auto numBytes = NumObjects * ObjectSize;
+    if (!poolConfig.pageExactBlocks)
+      return numBytes;
+    const auto gran = pageGranularity(numBytes);
+    return (numBytes + gran - 1) & ~(gran - 1);
+  }
+
+  /// Returns the alignment of a block of \p NumBytes bytes
+  size_t blockAlignment(size_t NumBytes, size_t ObjectAlignment) const
+      noexcept {
+    const auto align = memAlignment(ObjectAlignment);
+    if (!poolConfig.pageExactBlocks)
+      return align;
+    return std::max(align, pageGranularity(NumBytes));
+  }
+
+  /// Allocates a block of \p NumBytes bytes, preferably from the parent.
+  /// Blocks with fundamental alignment are allocated with malloc, such that a
+  /// \p Zeroed block can be obtained with calloc; for large blocks this is
+  /// (mostly) free, because the memory comes freshly mapped from the OS.
+  BlockInfo allocateBlock(size_t NumBytes, size_t Alignment, bool Zeroed) {
+    void *mem = nullptr;
+    if (parent && (mem = parent->acquire(NumBytes, Alignment))) {
+      if (Zeroed)
+        std::memset(mem, 0, NumBytes);
+    } else {
+      mem = BlockCache::allocateBlock(NumBytes, Alignment, Zeroed);
+    }
+    return {static_cast<char *>(mem), 0, NumBytes, Alignment};
+  }
+
+  /// Reuses the bookkeeping storage of a former child of the parent
+  void takeMetadata() noexcept {
+    Metadata md;
+    if (parent->acquireMetadata(md))
+      swapMetadata(md);
+  }
+
+  /// Gives the emptied bookkeeping storage to the parent for its next child.
+  /// Must be called after release().
+  void giveBackMetadata() noexcept {
+    try {
+      spareBlockLists.reserve(spareBlockLists.size() + configs.size());
+      for (auto &config : configs)
+        spareBlockLists.push_back(std::move(config.blocks));
+    } catch (const std::bad_alloc &) {
+      // The remaining Config::blocks are just freed
+    }
+    typeInfos.clear();
+    configs.clear();
+    tagLiveBytes.clear();
+    releaseHooks.clear();
+
+    Metadata md;
+    swapMetadata(md);
+    if (md.typeInfos.capacity())
+      parent->recycleMetadata(std::move(md));
+  }
+
+  /// Returns \p Blck to the parent, if any, and to the system otherwise
+  void freeBlock(const BlockInfo &Blck) noexcept {
+    MEM_PROBE1(driver_block_destroy, Blck.data);
+    if (parent) {
+      parent->recycle(Blck.data, Blck.numBytes, Blck.alignment);
+      return;
+    }
+    BlockCache::freeBlock(Blck.data, Blck.alignment);
+  }
+
+  /// Deallocates all blocks and direct objects of \p Id
+  void releaseBlocks(size_t Id) noexcept {
+    auto &config = configs[Id];
+    for (auto &blck : config.blocks)
+      freeBlock(blck);
+    for (auto *hdr = config.directObjects; hdr;) {
+      auto *next = hdr->next;
+      freeDirect(hdr + 1, Id);
+      hdr = next;
+    }
+    config.blocks.clear();
+    if (config.remoteFrees)
+      config.remoteFrees->head.store(nullptr, std::memory_order_relaxed);
+    config.current = nullptr;
+    config.freeList = nullptr;
+    config.pos = config.last = 0;
+    config.directObjects = nullptr;
+  }
+
+  /// Removes the empty blocks of \p Id, see reclaimEmptyBlocks()
+  size_t reclaimEmptyBlocks(size_t Id) {
+    auto &config = configs[Id];
+    if (config.direct || !config.freeList)
+      return 0;
+
+    const auto osize = typeInfos[Id].objectSize;
+
+    struct Range {
+      size_t blockIdx;
+      size_t numUsed;
+      size_t numFree;
+    };
+    std::vector<Range> ranges;
+    for (size_t i = 0, n = config.blocks.size(); i < n; ++i) {
+      const auto &blck = config.blocks[i];
+      const auto numUsed =
+          blck.data == config.current ? config.pos / osize : blck.numObjects;
+      ranges.push_back({i, numUsed, 0});
+    }
+    std::sort(ranges.begin(), ranges.end(), [&](auto &R1, auto &R2) {
+      return config.blocks[R1.blockIdx].data < config.blocks[R2.blockIdx].data;
+    });
+
+    auto rangeOf = [&](const void *Chunk) -> Range & {
+      auto it = std::upper_bound(
+          ranges.begin(), ranges.end(), static_cast<const char *>(Chunk),
+          [&](const char *Ptr, auto &R) {
+            return Ptr < config.blocks[R.blockIdx].data;
+          });
+      return *std::prev(it);
+    };
+    for (auto fl = config.freeList; fl; fl = reinterpret_cast<void **>(*fl))
+      ++rangeOf(fl).numFree;
+
+    auto isEmpty = [](const Range &R) {
+      return R.numUsed && R.numFree == R.numUsed;
+    };
+    if (std::none_of(ranges.begin(), ranges.end(), isEmpty))
+      return 0;
+
+    // Drop the chunks of the empty blocks from the free-list
+    void **link = reinterpret_cast<void **>(&config.freeList);
+    for (auto fl = config.freeList; fl; fl = reinterpret_cast<void **>(*fl)) {
+      if (!isEmpty(rangeOf(fl))) {
+        *link = fl;
+        link = fl;
+      }
+    }
+    *link = nullptr;
+
+    std::vector<bool> empty(config.blocks.size());
+    for (auto &range : ranges)
+      empty[range.blockIdx] = isEmpty(range);
+
+    emptyBlocks.reserve(emptyBlocks.size() + ranges.size());
+    size_t numKept = 0;
+    for (size_t i = 0, n = config.blocks.size(); i < n; ++i) {
+      const auto &blck = config.blocks[i];
+      if (!empty[i]) {
+        config.blocks[numKept++] = blck;
+        continue;
+      }
 
-    static std::pair<Block *, size_t>
-    create(BlockBase *nxt, size_t ObjectSize, size_t ObjectAlignment,
-           size_t BlockSize = AllocationBlockSize) {
-      const auto chunkSize = std::max(ObjectSize, ObjectAlignment);
-      const auto offset = std::max(sizeof(Block), ObjectAlignment);
-      const auto numBytes = offset + BlockSize * chunkSize;
+      if (blck.data == config.current) {
+        // The block that has been filled is gone; start a new one on the next
+        // allocation
+        config.current = nullptr;
+        config.pos = config.last = 0;
+        config.zeroed = false;
+      }
+      if (config.uniform && blck.numBytes == poolConfig.uniformBlockBytes)
+        emptyBlocks.push_back(blck);
+      else
+        freeBlock(blck);
+    }
+
+    const auto ret = config.blocks.size() - numKept;
+    config.blocks.resize(numKept);
+    return ret;
+  }
 
-      auto ret = reinterpret_cast<Block *>(
-          ::new (std::align_val_t{ObjectAlignment}) char[numBytes]);
+  /// Takes over the objects that other threads have deallocated with \p Id.
+  /// Returns true, iff they are on the free-list now.
+  bool collectRemoteFrees(size_t Id) noexcept {
+    auto &config = configs[Id];
+    auto *fl = static_cast<void **>(
+        config.remoteFrees->head.exchange(nullptr, std::memory_order_acquire));
+    if (!fl)
+      return false;
+    if (!config.direct) {
+      config.freeList = fl;
+      return true;
+    }
+    while (fl) {
+      auto *next = static_cast<void **>(*fl);
+      deallocateDirect(fl, Id);
+      fl = next;
+    }
+    return false;
+  }
 
-      ret->next = nxt;
+  /// Adds \p Blck to the blocks of \p Id and makes it the one that is filled
+  void pushBlock(size_t Id, BlockInfo Blck, bool Zeroed) {
+    auto &config = configs[Id];
+    const auto osize = typeInfos[Id].objectSize;
+
+    Blck.numObjects = Blck.numBytes / osize;
+    try {
+      config.blocks.push_back(Blck);
+    } catch (...) {
+      freeBlock(Blck);
+      throw;
+    }
+    MEM_PROBE3(driver_block_create, Blck.data, Blck.numObjects, osize);
+    config.current = Blck.data;
+    config.pos = 0;
+    config.last = Blck.numObjects * osize;
+    config.zeroed = Zeroed;
+  }
 
-      return {ret, offset - sizeof(Block)};
+  /// Allocates the next block for \p Id and makes it the one that is filled.
+  /// Returns its data.
+  char *addBlock(size_t Id, bool Zeroed) {
+    auto &config = configs[Id];
+    const auto [osize, oalign] = typeInfos[Id];
+    const auto blockSize = config.blockSize;
+
+    BlockInfo blck;
+    if (config.uniform && !emptyBlocks.empty()) {
+      // Reformat an empty block of another size-class
+      blck = emptyBlocks.back();
+      emptyBlocks.pop_back();
+      if (Zeroed)
+        std::memset(blck.data, 0, blck.numBytes);
+    } else {
+      const auto numBytes = config.uniform ? poolConfig.uniformBlockBytes
+                                           : blockBytes(osize, blockSize);
+      blck = allocateBlock(numBytes, blockAlignment(numBytes, oalign), Zeroed);
     }
+    pushBlock(Id, blck, Zeroed);
 
-    static void destroy(BlockBase *Blck, size_t ObjectAlignment) {
-      ::operator delete[](reinterpret_cast<char *>(Blck),
-                          std::align_val_t{ObjectAlignment});
+    if (__builtin_expect(poolConfig.prefault, false)) {
+      // Write one byte per page; the chunks are uninitialized (or zero) anyway
+      volatile char *data = blck.data;
+      for (size_t i = 0; i < config.last; i += PageSize)
+        data[i] = 0;
     }
-  };
+    if (poolConfig.growthFactor > 1 && !config.uniform) {
+      config.blockSize = std::max<size_t>(
+          blockSize, std::min(blockSize * poolConfig.growthFactor,
+                              poolConfig.maxBlockBytes / osize));
+    }
+
+    return blck.data;
+  }
 
 public:
   using UserAllocatorId = detail::SubtypeAllocatorDriverBase::UserAllocatorId;
+  using AllocationTag = detail::SubtypeAllocatorDriverBase::AllocationTag;
+  using SizeClassStatistics =
+      detail::SubtypeAllocatorDriverBase::SizeClassStatistics;
   static constexpr UserAllocatorId InvalidId =
       detail::SubtypeAllocatorDriverBase::InvalidId;
 
-  explicit SubtypeAllocatorDriver() noexcept = default;
+  /// The size of a memory page
+  static constexpr size_t PageSize = 4096;
+  /// The size of a huge page, see PoolConfig::pageExactBlocks
+  static constexpr size_t HugePageSize = size_t(2) << 20;
+  /// The granularity in which allocate_near() considers chunks to be near
+  static constexpr size_t NearPageSize = PageSize;
+  /// The maximum number of free-list entries allocate_near() inspects
+  static constexpr size_t NearSearchLimit = 16;
+
+  /// The default for the largest number of bytes of one block
+  static constexpr size_t DefaultMaxBlockBytes = PoolConfig{}.maxBlockBytes;
+  /// The default for the object size from which on objects are not pooled
+  static constexpr size_t DefaultDirectThreshold =
+      PoolConfig{}.directThreshold;
+
+  /// \param MaxBlockBytes Limits the number of objects per block, such that
+  /// a block does not exceed this number of bytes, unless it only holds a
+  /// single object
+  /// \param DirectThreshold Objects of at least this size are allocated one by
+  /// one instead of in blocks
+  explicit SubtypeAllocatorDriver(
+      size_t MaxBlockBytes = DefaultMaxBlockBytes,
+      size_t DirectThreshold = DefaultDirectThreshold) noexcept {
+    poolConfig.maxBlockBytes = MaxBlockBytes;
+    poolConfig.directThreshold = DirectThreshold;
+  }
+  /// \brief Creates a driver that is configured at runtime, e.g. with
+  /// PoolConfig::fromEnvironment(). The \c blockSize of \p Config overrides
+  /// AllocationBlockSize.
+  explicit SubtypeAllocatorDriver(const PoolConfig &Config) noexcept
+      : poolConfig(Config) {}
+  /// \brief Creates a child driver that takes its blocks from \p Parent and
+  /// gives them back when it is released or destroyed, e.g. a cheap pool for
+  /// a single request. \p Parent must outlive this driver.
+  explicit SubtypeAllocatorDriver(BlockCache &Parent) noexcept
+      : parent(&Parent) {
+    takeMetadata();
+  }
+  /// Same as SubtypeAllocatorDriver(BlockCache &), but configured at runtime
+  SubtypeAllocatorDriver(BlockCache &Parent, const PoolConfig &Config) noexcept
+      : poolConfig(Config), parent(&Parent) {
+    takeMetadata();
+  }
   SubtypeAllocatorDriver(const SubtypeAllocatorDriver &) = delete;
   SubtypeAllocatorDriver(SubtypeAllocatorDriver &&) = default;
   ~SubtypeAllocatorDriver() {
-    size_t i = 0;
-    for (auto &config : configs) {
-      auto *blck = config.root;
-      auto oalign = typeInfos[i].objectAlignment;
-      while (blck) {
-        auto *next = blck->next;
-        Block::destroy(blck, oalign);
-        blck = next;
-      }
-      ++i;
-    }
+    if (__builtin_expect(poolConfig.printStatistics, false))
+      printStatistics(stderr);
+    release();
+    if (parent)
+      giveBackMetadata();
     typeInfos.clear();
     configs.clear();
+    tagLiveBytes.clear();
+  }
+
+  /// \brief Deallocates all blocks at once without visiting the objects in
+  /// them, e.g. to drop a large cache or to shut down quickly. All objects
+  /// that have been allocated from this driver become invalid; their
+  /// destructors are NOT called. The Ids stay valid, so the driver can be
+  /// reused afterwards.
+  ///
+  /// See mem::discard() for leaving containers that use this driver empty
+  /// without traversing their nodes.
+  void release() noexcept {
+    for (size_t id = 0, numIds = configs.size(); id < numIds; ++id)
+      releaseBlocks(id);
+    for (auto &blck : emptyBlocks)
+      freeBlock(blck);
+    emptyBlocks.clear();
+    std::fill(tagLiveBytes.begin(), tagLiveBytes.end(), 0);
+  }
+
+  /// \brief Same as release(), but only deallocates the blocks of the Ids
+  /// with lifetime class \p L, e.g. all short-lived temporaries at once. The
+  /// objects of the other lifetime classes stay valid.
+  /// Note: Does not update the live bytes of the allocation tags.
+  void release(Lifetime L) noexcept {
+    for (size_t id = 0, numIds = configs.size(); id < numIds; ++id) {
+      if (configs[id].lifetime == L)
+        releaseBlocks(id);
+    }
+  }
+
+  /// \brief Removes the blocks whose objects have all been deallocated from
+  /// their size-classes, e.g. after a phase of the program that used a type
+  /// heavily. Blocks of PoolConfig::uniformBlockBytes bytes are kept by the
+  /// driver and reused for any size-class that needs a new block; all other
+  /// empty blocks are freed (or given back to the parent BlockCache).
+  ///
+  /// Takes time linear in the number of free-list entries (times the
+  /// logarithm of the number of blocks).
+  /// \returns The number of reclaimed blocks
+  size_t reclaimEmptyBlocks() {
+    size_t ret = 0;
+    for (size_t id = 0, numIds = configs.size(); id < numIds; ++id)
+      ret += reclaimEmptyBlocks(id);
+    return ret;
+  }
+
+  /// Returns the number of empty blocks that are available to all
+  /// size-classes, see reclaimEmptyBlocks()
+  size_t getNumEmptyBlocks() const noexcept { return emptyBlocks.size(); }
+
+  /// Returns the lifetime class that \p Id has been created for
+  Lifetime getLifetime(UserAllocatorId Id) const noexcept {
+    return configs[Id].lifetime;
   }
 
   /// \brief For internal use only.
@@ -73,16 +434,35 @@ public:
   /// Returns the least number of bytes that are allocated for one object of
   /// type \p T
   template <typename T> static constexpr size_t normalizedSize() noexcept {
-    return std::max(sizeof(void *), (sizeof(T) + 7)) & ~7;
+    return normalizedSize(sizeof(T));
+  }
+  /// \brief For internal use only.
+  ///
+  /// Returns the least number of bytes that are allocated for one object of
+  /// \p ObjectSize bytes
+  static constexpr size_t normalizedSize(size_t ObjectSize) noexcept {
+    return std::max(sizeof(void *), (ObjectSize + 7)) & ~7;
   }
 
   /// \brief Computes an ID for use in the actual allocation process
   /// (allocate(UserAllocatorId)). This method takes linear time in the number
   /// of types it has been called for previously.
-  template <typename T> UserAllocatorId getId() {
-    constexpr auto ObjectSize = sizeof(T);
-    constexpr auto ObjectAlignment = alignof(T);
-    constexpr auto NormalizedSize = normalizedSize<T>();
+  ///
+  /// Objects with a different lifetime class \p L get a separate Id (and
+  /// therefore separate blocks), even if they have the same size.
+  template <typename T>
+  UserAllocatorId getId(Lifetime L = Lifetime::Default) {
+    return getId(sizeof(T), alignof(T), L);
+  }
+
+  /// \brief Same as getId<T>(), but for objects of \p ObjectSize bytes with
+  /// an alignment of \p ObjectAlignment, e.g. for untyped allocations.
+  UserAllocatorId getId(size_t ObjectSize, size_t ObjectAlignment,
+                        Lifetime L = Lifetime::Default) {
+    // Untyped sizes need not be a multiple of their alignment
+    const auto NormalizedSize =
+        (normalizedSize(ObjectSize) + ObjectAlignment - 1) &
+        ~(ObjectAlignment - 1);
 
     // std::cerr << "> getId(" << ObjectSize << ", " << ObjectAlignment
     //          << ", normalizedSize=" << NormalizedSize << ") = ";
@@ -99,7 +479,8 @@ public:
 
         for (size_t i = 0; i < size; ++i) {
           auto [osize, oalign] = ti[i];
-          if (osize == NormalizedSize && oalign >= ObjectAlignment) {
+          if (osize == NormalizedSize && oalign >= ObjectAlignment &&
+              configs[i].lifetime == L) {
             if (oalign < alignment) {
               alignment = oalign;
               id = i;
@@ -126,11 +507,46 @@ public:
     // search. However, the size of the ti and conf vectors is expected to be
     // very small (5 - 10 at most)
     typeInfos.emplace_back(NormalizedSize, ObjectAlignment);
-    configs.emplace_back(nullptr, nullptr, 0, 0);
+    auto &config = configs.emplace_back(nullptr, nullptr, 0, 0);
+    if (!spareBlockLists.empty()) {
+      config.blocks.swap(spareBlockLists.back());
+      spareBlockLists.pop_back();
+    }
+    config.lifetime = L;
+    config.direct = NormalizedSize >= poolConfig.directThreshold;
+    config.blockSize = std::max<size_t>(
+        1, std::min(poolConfig.blockSize ? poolConfig.blockSize
+                                         : AllocationBlockSize,
+                    poolConfig.maxBlockBytes / NormalizedSize));
+    if (poolConfig.uniformBlockBytes && !config.direct &&
+        ObjectAlignment <= alignof(std::max_align_t) &&
+        poolConfig.uniformBlockBytes >= NormalizedSize) {
+      config.uniform = true;
+      config.blockSize = poolConfig.uniformBlockBytes / NormalizedSize;
+    }
+    MEM_PROBE3(driver_new_size_class, ret, NormalizedSize, ObjectAlignment);
 
     return ret;
   }
 
+  /// \brief Allows any thread to deallocate the objects with \p Id, e.g. for
+  /// a driver that is owned by one thread, but whose objects are shared.
+  ///
+  /// The calling thread becomes the owner of \p Id: It is the only one that
+  /// allocates objects with \p Id, and its deallocations still use the
+  /// free-list. Deallocations from all other threads are pushed to a lock-free
+  /// list instead. The owner takes them over in bulk when its current block is
+  /// exhausted, before allocating a new one. Statistics and
+  /// reclaimEmptyBlocks() do not consider the objects on this list.
+  ///
+  /// Must be called before any object with \p Id is allocated. All Ids must
+  /// have been created before other threads deallocate.
+  void enableRemoteDeallocation(UserAllocatorId Id) {
+    auto &config = configs[Id];
+    if (!config.remoteFrees)
+      config.remoteFrees = &remoteFreeLists.emplace_back();
+  }
+
   /// \brief Allocates an uninitialized chunk of memory large enough for holding
   /// an object with the specified \p Id. The memory chunk is properly aligned
   /// and supports over-alignment.
@@ -145,27 +561,281 @@ public:
       return ret;
     }
 
-    auto *blck = config.root;
+    auto *data = config.current;
     auto pos = config.pos;
     const auto last = config.last;
-    const auto [osize, oalign] = typeInfos[Id];
+    const auto osize = typeInfos[Id].objectSize;
 
-    // std::cerr << "ti{ osize=" << osize << ", oalign=" << oalign << " }, ";
+    // std::cerr << "ti{ osize=" << osize << " }, ";
     // std::cerr << "cf{ pos=" << pos << ", last=" << last << " } ";
 
     if (pos + osize > last) {
+      if (__builtin_expect(config.remoteFrees != nullptr, false) &&
+          collectRemoteFrees(Id))
+        return allocate(Id);
+      if (__builtin_expect(config.direct, false))
+        return allocateDirect(Id);
+
       // std::cerr << "needs to allocate a new Block\n";
-      std::tie(blck, pos) = Block::create(blck, osize, oalign);
-      config.root = blck;
-      config.last = AllocationBlockSize * osize + pos;
+      data = addBlock(Id, false);
+      pos = 0;
+    }
+
+    void *ret = &data[pos];
+    config.pos = pos + osize;
+
+    return ret;
+  }
+
+  /// \brief Same as allocate(UserAllocatorId), but prefers a chunk close to \p
+  /// Hint, i.e. in the same memory page, to co-locate objects that are
+  /// accessed together.
+  ///
+  /// Only the first NearSearchLimit entries of the free-list are considered, so
+  /// this stays constant-time. If none of them is near \p Hint, but \p Hint
+  /// lies in the block that is currently filled, a fresh chunk from that block
+  /// is used. Otherwise, falls back to allocate(UserAllocatorId).
+  void *allocate_near(UserAllocatorId Id, const void *Hint) {
+    auto &config = configs[Id];
+    const auto hintPage = reinterpret_cast<uintptr_t>(Hint) / NearPageSize;
+
+    void **prev = nullptr;
+    auto fl = config.freeList;
+    for (size_t i = 0; fl && i < NearSearchLimit; ++i) {
+      if (reinterpret_cast<uintptr_t>(fl) / NearPageSize == hintPage) {
+        auto nxt = reinterpret_cast<void **>(*fl);
+        if (prev)
+          *prev = nxt;
+        else
+          config.freeList = nxt;
+        return fl;
+      }
+      prev = fl;
+      fl = reinterpret_cast<void **>(*fl);
+    }
+
+    const auto osize = typeInfos[Id].objectSize;
+    const auto pos = config.pos;
+    if (config.current && pos + osize <= config.last) {
+      auto *data = config.current;
+      auto *hint = static_cast<const char *>(Hint);
+      if (hint >= data && hint < data + config.last) {
+        config.pos = pos + osize;
+        return &data[pos];
+      }
     }
 
-    void *ret = &static_cast<Block *>(blck)->data[pos];
+    return allocate(Id);
+  }
+
+  /// \brief Same as allocate(UserAllocatorId), but the returned memory chunk is
+  /// filled with zeros.
+  ///
+  /// Chunks that are recycled from the free-list are cleared explicitly. Fresh
+  /// blocks are requested zero-filled from the OS, so the chunks that have not
+  /// been handed out from them yet are known to be zero and are returned
+  /// without touching them.
+  void *allocate_zeroed(UserAllocatorId Id) {
+    auto &config = configs[Id];
+    const auto [osize, oalign] = typeInfos[Id];
+
+    if (config.freeList) {
+      auto ret = config.freeList;
+      config.freeList = reinterpret_cast<void **>(*ret);
+      std::memset(ret, 0, osize);
+      return ret;
+    }
+
+    auto *data = config.current;
+    auto pos = config.pos;
+
+    if (pos + osize > config.last) {
+      if (__builtin_expect(config.remoteFrees != nullptr, false) &&
+          collectRemoteFrees(Id))
+        return allocate_zeroed(Id);
+      if (__builtin_expect(config.direct, false))
+        return allocateDirect(Id);
+
+      data = addBlock(Id, true);
+      pos = 0;
+    }
+
+    void *ret = &data[pos];
     config.pos = pos + osize;
 
+    if (!config.zeroed)
+      std::memset(ret, 0, osize);
+
+    return ret;
+  }
+
+  /// \brief Same as allocate(UserAllocatorId), but additionally accounts the
+  /// allocated object to \p Tag. Objects allocated with this function must be
+  /// deallocated with deallocate(void*, UserAllocatorId, AllocationTag) using
+  /// the same \p Tag.
+  void *allocate(UserAllocatorId Id, AllocationTag Tag) {
+    if (__builtin_expect(Tag >= tagLiveBytes.size(), false))
+      tagLiveBytes.resize(Tag + 1);
+
+    auto *ret = allocate(Id);
+    tagLiveBytes[Tag] += typeInfos[Id].objectSize;
+    return ret;
+  }
+
+  /// \brief Computes the current SizeClassStatistics of all Ids. Does not
+  /// need any bookkeeping during (de-)allocation, but takes time linear in the
+  /// number of blocks and free-list entries.
+  std::vector<SizeClassStatistics> getStatistics() const {
+    std::vector<SizeClassStatistics> ret;
+    ret.reserve(typeInfos.size());
+
+    for (size_t id = 0, numIds = typeInfos.size(); id < numIds; ++id) {
+      const auto &config = configs[id];
+      const auto [osize, oalign] = typeInfos[id];
+      auto &stats =
+          ret.emplace_back(SizeClassStatistics{osize, oalign, 0, 0, 0, 0});
+
+      for (auto &blck : config.blocks) {
+        ++stats.numBlocks;
+        stats.capacity += blck.numObjects;
+        stats.numUsed += blck.data == config.current ? config.pos / osize
+                                                     : blck.numObjects;
+      }
+
+      stats.numLive = stats.numUsed;
+      for (auto fl = config.freeList; fl; fl = reinterpret_cast<void **>(*fl))
+        --stats.numLive;
+
+      // Direct objects are counted as blocks of their own
+      for (auto *hdr = config.directObjects; hdr; hdr = hdr->next) {
+        ++stats.numBlocks;
+        ++stats.capacity;
+        ++stats.numUsed;
+        ++stats.numLive;
+      }
+    }
+
     return ret;
   }
 
+  /// Prints the current SizeClassStatistics of all Ids to \p Out
+  void printStatistics(std::FILE *Out) const {
+    const auto stats = getStatistics();
+    for (size_t id = 0; id < stats.size(); ++id) {
+      const auto &st = stats[id];
+      std::fprintf(Out,
+                   "[mem] size-class %zu: objectSize=%zu, blocks=%zu, "
+                   "capacity=%zu, peak=%zu, live=%zu\n",
+                   id, st.objectSize, st.numBlocks, st.capacity, st.numUsed,
+                   st.numLive);
+    }
+  }
+
+  /// \brief Checks whether \p Ptr points into one of the blocks of this
+  /// driver. Takes time linear in the number of blocks.
+  bool owns(const void *Ptr) const noexcept {
+    auto ptr = static_cast<const char *>(Ptr);
+    for (size_t id = 0, numIds = typeInfos.size(); id < numIds; ++id) {
+      const auto osize = typeInfos[id].objectSize;
+      for (auto &blck : configs[id].blocks) {
+        if (ptr >= blck.data && ptr < blck.data + blck.numObjects * osize)
+          return true;
+      }
+      for (auto *hdr = configs[id].directObjects; hdr; hdr = hdr->next) {
+        auto *begin = reinterpret_cast<const char *>(hdr + 1);
+        if (ptr >= begin && ptr < begin + osize)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  /// \brief Calls \p F for every object that has been allocated with \p Id and
+  /// has not been deallocated yet.
+  template <typename Fn> void forEachAllocated(UserAllocatorId Id, Fn &&F) {
+    const auto &config = configs[Id];
+    const auto osize = typeInfos[Id].objectSize;
+
+    std::unordered_set<const void *> freeChunks;
+    for (auto *hdr = config.directObjects; hdr; hdr = hdr->next)
+      F(static_cast<void *>(hdr + 1));
+
+    for (auto fl = config.freeList; fl; fl = reinterpret_cast<void **>(*fl))
+      freeChunks.insert(fl);
+
+    for (auto &blck : config.blocks) {
+      auto *data = blck.data;
+      const auto end =
+          data == config.current ? config.pos : blck.numObjects * osize;
+
+      for (size_t pos = 0; pos + osize <= end; pos += osize) {
+        if (!freeChunks.count(&data[pos]))
+          F(static_cast<void *>(&data[pos]));
+      }
+    }
+  }
+
+  /// \brief Copies all blocks of this driver into \p Target, such that \p
+  /// Target contains a bitwise copy of every allocated object, and records the
+  /// address-ranges of the copies in \p Relocations. Pointers between the
+  /// copied objects are NOT adjusted; use \p Relocations for that.
+  ///
+  /// \p Target must not have allocated any objects yet. Its Ids are replaced by
+  /// the ones of this driver.
+  void cloneInto(SubtypeAllocatorDriver &Target,
+                 RelocationTable &Relocations) const {
+    assert(std::all_of(Target.configs.begin(), Target.configs.end(),
+                       [](auto &Config) { return Config.blocks.empty(); }) &&
+           "Can only clone into an empty SubtypeAllocatorDriver");
+
+    Target.typeInfos = typeInfos;
+    Target.configs.clear();
+    Target.tagLiveBytes = tagLiveBytes;
+    Target.poolConfig = poolConfig;
+
+    for (size_t id = 0, numIds = typeInfos.size(); id < numIds; ++id) {
+      const auto &config = configs[id];
+      const auto osize = typeInfos[id].objectSize;
+      auto &tgtConfig = Target.configs.emplace_back(nullptr, nullptr,
+                                                    config.pos, config.last);
+      tgtConfig.zeroed = config.zeroed;
+      tgtConfig.direct = config.direct;
+      tgtConfig.uniform = config.uniform;
+      tgtConfig.lifetime = config.lifetime;
+      tgtConfig.blockSize = config.blockSize;
+
+      tgtConfig.blocks.reserve(config.blocks.size());
+      for (auto &blck : config.blocks) {
+        auto nw = Target.allocateBlock(blck.numBytes, blck.alignment, false);
+        nw.numObjects = blck.numObjects;
+        const auto numBytes = blck.numObjects * osize;
+        std::memcpy(nw.data, blck.data, numBytes);
+        Relocations.add(blck.data, numBytes, nw.data, osize);
+
+        tgtConfig.blocks.push_back(nw);
+        if (blck.data == config.current)
+          tgtConfig.current = nw.data;
+      }
+
+      for (auto *hdr = config.directObjects; hdr; hdr = hdr->next) {
+        auto *nw = Target.allocateDirect(id);
+        std::memcpy(nw, hdr + 1, osize);
+        Relocations.add(hdr + 1, osize, nw, osize);
+      }
+    }
+
+    Relocations.finalize();
+
+    // The free-lists are copied as well, but still point to the old blocks
+    for (size_t id = 0, numIds = typeInfos.size(); id < numIds; ++id) {
+      auto fl = reinterpret_cast<void **>(
+          Relocations.relocate(configs[id].freeList));
+      Target.configs[id].freeList = fl;
+      for (; fl; fl = reinterpret_cast<void **>(*fl))
+        *fl = Relocations.relocate(*fl);
+    }
+  }
+
   /// \brief Allocates enough space, such that at least the following \p
   /// NumNewObjects allocations with the same \p Id do not require an actual
   /// memory allocation using \c new.
@@ -178,12 +848,16 @@ public:
     // We will never call reserve(0)
     if (__builtin_expect(NumNewObjects == 0, false))
       return;
+    // Direct objects are allocated one by one anyway
+    if (configs[Id].direct)
+      return;
+    MEM_PROBE2(driver_reserve, Id, NumNewObjects);
 
     auto &config = configs[Id];
 
     auto pos = config.pos;
     const auto last = config.last;
-    auto [osize, oalign] = typeInfos[Id];
+    const auto [osize, oalign] = typeInfos[Id];
 
     auto rem = (last - pos) / osize;
     if (rem > NumNewObjects)
@@ -196,10 +870,10 @@ public:
       // the free-list.
       // Note: This is the slow path. It will (probably) never be taken, because
       // reserving space is typically done before the first allocation.
-      auto rt = config.root;
+      auto *data = config.current;
       auto fl = config.freeList;
 
-      for (auto *it = &rt->data[last - osize], *end = &rt->data[pos]; it >= end;
+      for (auto *it = &data[last - osize], *end = &data[pos]; it >= end;
            it -= osize) {
         auto nxt = reinterpret_cast<void **>(it);
         *nxt = fl;
@@ -209,11 +883,10 @@ public:
       config.freeList = fl;
     }
 
-    std::tie(config.root, pos) =
-        Block::create(config.root, osize, oalign, NumNewObjects);
-
-    config.pos = pos;
-    config.last = pos + NumNewObjects * osize;
+    const auto numBytes = blockBytes(osize, NumNewObjects);
+    pushBlock(Id,
+              allocateBlock(numBytes, blockAlignment(numBytes, oalign), false),
+              false);
   }
 };
 } // namespace mem
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
 #include "mem/SubtypeAllocator/Factories/DefaultSharedPtrFactory.hpp"
+#include "mem/SubtypeAllocator/Factories/OutOfLineRefcFactory.hpp"
+#include "mem/SubtypeAllocator/Factories/ParallelRefcFactory.hpp"
 #include "mem/SubtypeAllocator/Factories/RefcFactory.hpp"
 #include "mem/SubtypeAllocator/Factories/SharedPtrFactory.hpp"
+#include "mem/SubtypeAllocator/Factories/SwitchableSharedPtrFactory.hpp"
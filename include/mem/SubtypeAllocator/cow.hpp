@@ -0,0 +1,60 @@
+#pragma once
+
+#include <utility>
+
+#include "mem/SubtypeAllocator/refc.hpp"
+
+namespace mem {
+
+/// \brief A copy-on-write value wrapper around a refc.
+///
+/// Copies of a cow share the same pooled object. The first mutable access
+/// through write() on a cow whose object is shared with others clones the
+/// object into a new slot allocated with the \p Factory, so the other copies
+/// keep observing the old value.
+///
+/// \tparam T The type of the wrapped value. Must be copy-constructible
+/// \tparam Factory The factory used for creating and cloning the value, e.g. a
+/// RefcFactory that can create objects of type \p T. It must outlive all cow
+/// objects that refer to it.
+template <typename T, typename Factory> class cow {
+  refc<T> Ptr;
+  Factory *Fac;
+
+public:
+  /// \brief Creates a new value in \p F and forwards \p args to \p T's
+  /// constructor.
+  template <typename... Args>
+  explicit cow(Factory &F, Args &&... args)
+      : Ptr(F.template create<T>(std::forward<Args>(args)...)), Fac(&F) {}
+
+  /// \brief Wraps the already existing object \p Rc that may be shared with
+  /// other refcs. \p Rc must not be in \c nullptr state.
+  cow(Factory &F, refc<T> Rc) noexcept : Ptr(std::move(Rc)), Fac(&F) {}
+
+  cow(const cow &) noexcept = default;
+  cow(cow &&) noexcept = default;
+  cow &operator=(const cow &) noexcept = default;
+  cow &operator=(cow &&) noexcept = default;
+
+  /// Read-only access. Never clones.
+  const T &read() const noexcept { return *Ptr; }
+  const T &operator*() const noexcept { return *Ptr; }
+  const T *operator->() const noexcept { return Ptr.get(); }
+
+  /// \brief Mutable access. Clones the value first, if it is currently shared
+  /// or interned (an interned object is looked up by its value, which
+  /// therefore must not change).
+  T &write() {
+    if (!Ptr.unique() || Ptr.has_release_hook())
+      Ptr = Fac->template create<T>(*Ptr);
+    return *Ptr;
+  }
+
+  /// Returns the wrapped refc
+  const refc<T> &get_refc() const noexcept { return Ptr; }
+
+  /// Checks whether this cow currently is the only owner of its value
+  bool unique() const noexcept { return Ptr.unique(); }
+};
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "mem/SubtypeAllocator/detail/SubtypeAllocatorDriverBase.hpp"
+#include "mem/SubtypeAllocator/refc.hpp"
+
+namespace mem {
+namespace detail {
+
+/// \brief An open-addressing hash-set (linear probing) of weak references to
+/// refc-managed objects of type \p T. Used by RefcFactory::intern().
+///
+/// The table does not own its entries: Each interned object carries the index
+/// of a release-hook in its control-block that removes it from the table right
+/// before the object is destroyed.
+template <typename T, typename Hash = std::hash<T>,
+          typename KeyEqual = std::equal_to<T>>
+class InternTable {
+  using one_allocation = typename refc<T>::one_allocation;
+
+  struct Entry {
+    size_t hash;
+    one_allocation *obj;
+  };
+
+  std::vector<Entry> slots;
+  size_t numEntries = 0;
+  size_t hookIdx = 0;
+
+  static const T &value(one_allocation *Obj) noexcept {
+    return *reinterpret_cast<const T *>(&Obj->Data);
+  }
+
+  size_t mask() const noexcept { return slots.size() - 1; }
+
+  void grow() {
+    std::vector<Entry> old(slots.empty() ? 16 : slots.size() * 2);
+    old.swap(slots);
+
+    for (auto &entry : old) {
+      if (!entry.obj)
+        continue;
+      auto i = entry.hash & mask();
+      while (slots[i].obj)
+        i = (i + 1) & mask();
+      slots[i] = entry;
+    }
+  }
+
+  void erase(one_allocation *Obj) noexcept {
+    auto i = Hash{}(value(Obj)) & mask();
+    while (slots[i].obj != Obj)
+      i = (i + 1) & mask();
+
+    // Backward-shift deletion: Move succeeding entries of the probe sequence
+    // into the gap, such that no tombstones are needed.
+    for (auto j = (i + 1) & mask(); slots[j].obj; j = (j + 1) & mask()) {
+      auto home = slots[j].hash & mask();
+      // Is home cyclically outside of (i, j]?
+      if ((j > i && (home <= i || home > j)) ||
+          (j < i && home <= i && home > j)) {
+        slots[i] = slots[j];
+        i = j;
+      }
+    }
+
+    slots[i] = {0, nullptr};
+    --numEntries;
+  }
+
+  static void onRelease(void *Ctx, void *Obj) noexcept {
+    static_cast<InternTable *>(Ctx)->erase(static_cast<one_allocation *>(Obj));
+  }
+
+public:
+  explicit InternTable() noexcept = default;
+  InternTable(const InternTable &) = delete;
+  InternTable &operator=(const InternTable &) = delete;
+
+  /// \brief Looks up an object equal to \p *Candidate. If there is one,
+  /// returns a new reference to it and releases \p Candidate; otherwise, adds
+  /// \p Candidate to the table and returns it.
+  ///
+  /// \p Candidate must be the only reference to an object that has been
+  /// allocated from \p Driver.
+  refc<T> intern(SubtypeAllocatorDriverBase &Driver, refc<T> &&Candidate) {
+    if (__builtin_expect(!hookIdx, false))
+      hookIdx = Driver.registerReleaseHook(&InternTable::onRelease, this);
+
+    if ((numEntries + 1) * 4 > slots.size() * 3)
+      grow();
+
+    const auto hash = Hash{}(*Candidate);
+    auto i = hash & mask();
+    for (; slots[i].obj; i = (i + 1) & mask()) {
+      if (slots[i].hash == hash &&
+          KeyEqual{}(value(slots[i].obj), *Candidate)) {
+        return refc<T>(slots[i].obj, std::true_type{});
+      }
+    }
+
+    auto obj = static_cast<one_allocation *>(Candidate.Data);
+    obj->Id |= hookIdx << SubtypeAllocatorDriverBase::ReleaseHookShift;
+    slots[i] = {hash, obj};
+    ++numEntries;
+
+    return std::move(Candidate);
+  }
+
+  /// \brief Forgets all interned objects without touching them, e.g. after
+  /// their memory has been released as a whole.
+  void clear() noexcept {
+    slots.clear();
+    numEntries = 0;
+  }
+
+  /// Returns the number of currently interned objects
+  size_t size() const noexcept { return numEntries; }
+};
+
+} // namespace detail
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+
+/// \file
+/// Restartable sequences (rseq) for the per-CPU caches of
+/// PerCpuAllocatorDriver: short critical sections that the kernel aborts and
+/// restarts, if the thread is preempted, migrated or signaled before their
+/// final (commit) store. A thread can therefore modify the data of the CPU it
+/// runs on without any lock or atomic instruction.
+///
+/// The rseq area of each thread is registered by glibc (2.35 or newer) and
+/// found with \c __rseq_offset. The critical sections are implemented for
+/// x86-64 and AArch64 Linux. They are compiled out, if MEM_DISABLE_RSEQ is
+/// defined or under ThreadSanitizer, which cannot see the ordering that
+/// running on the same CPU provides.
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(MEM_DISABLE_RSEQ) && defined(__linux__) &&                        \
+    (defined(__x86_64__) || defined(__aarch64__)) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#define MEM_RSEQ_CANDIDATE 1
+#endif
+#endif
+
+#if defined(MEM_RSEQ_CANDIDATE) && defined(__SANITIZE_THREAD__)
+#undef MEM_RSEQ_CANDIDATE
+#endif
+#if defined(MEM_RSEQ_CANDIDATE) && defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#undef MEM_RSEQ_CANDIDATE
+#endif
+#endif
+
+#ifdef MEM_RSEQ_CANDIDATE
+#undef MEM_RSEQ_CANDIDATE
+#include <sys/rseq.h>
+#define MEM_HAVE_RSEQ 1
+#endif
+
+namespace mem {
+namespace detail {
+
+/// \brief The cache of one size-class on one CPU: a stack of \c count objects
+/// in \c slots. The critical sections below depend on this layout.
+struct CpuBin {
+  size_t count = 0;
+  void **slots = nullptr;
+};
+
+#ifdef MEM_HAVE_RSEQ
+static_assert(sizeof(void *) == 8 && offsetof(CpuBin, slots) == 8,
+              "the rseq critical sections assume this layout of CpuBin");
+
+/// \brief Returns the rseq area of the calling thread, or nullptr if glibc has
+/// not registered one (e.g. old kernel or \c glibc.pthread.rseq=0).
+inline struct rseq *currentRseq() noexcept {
+  if (__builtin_expect(__rseq_size == 0, false))
+    return nullptr;
+  char *tp;
+#if defined(__x86_64__)
+  __asm__("movq %%fs:0, %0" : "=r"(tp));
+#else
+  __asm__("mrs %0, tpidr_el0" : "=r"(tp));
+#endif
+  return reinterpret_cast<struct rseq *>(tp + __rseq_offset);
+}
+
+/// Returns true, iff the calling thread can run the critical sections below
+inline bool rseqAvailable() noexcept {
+  auto *rs = currentRseq();
+  return rs && static_cast<int32_t>(rs->cpu_id) >= 0;
+}
+
+/// \brief Pops an object from the CpuBin of the current CPU, which is at
+/// \p Bins + cpu * \p Stride. Returns nullptr, if the bin is empty or the
+/// current CPU is not below \p NumCpus.
+inline void *rseqPop(struct rseq *Rs, char *Bins, size_t Stride,
+                     size_t NumCpus) noexcept {
+  void *ret;
+  uint64_t bin, tmp;
+#if defined(__x86_64__)
+  __asm__ __volatile__(
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      "6:\n\t"
+      "leaq 3b(%%rip), %[tmp]\n\t"
+      "movq %[tmp], (%[cs])\n\t"
+      "1:\n\t"
+      "xorl %k[ret], %k[ret]\n\t"
+      "movl (%[cpu]), %k[bin]\n\t"
+      "cmpq %[ncpus], %[bin]\n\t"
+      "jae 2f\n\t"
+      "imulq %[stride], %[bin]\n\t"
+      "addq %[bins], %[bin]\n\t"
+      "movq (%[bin]), %[tmp]\n\t"
+      "testq %[tmp], %[tmp]\n\t"
+      "jz 2f\n\t"
+      "movq 8(%[bin]), %[ret]\n\t"
+      "movq -8(%[ret], %[tmp], 8), %[ret]\n\t"
+      "decq %[tmp]\n\t"
+      // Commit
+      "movq %[tmp], (%[bin])\n\t"
+      "2:\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".long %c[sig]\n\t"
+      "4:\n\t"
+      "jmp 6b\n\t"
+      ".popsection\n\t"
+      : [ret] "=&r"(ret), [bin] "=&r"(bin), [tmp] "=&r"(tmp)
+      : [cs] "r"(&Rs->rseq_cs), [cpu] "r"(&Rs->cpu_id), [bins] "r"(Bins),
+        [stride] "r"(Stride), [ncpus] "r"(NumCpus), [sig] "i"(RSEQ_SIG)
+      : "memory", "cc");
+#else
+  __asm__ __volatile__(
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      "6:\n\t"
+      "adrp %[tmp], 3b\n\t"
+      "add %[tmp], %[tmp], :lo12:3b\n\t"
+      "str %[tmp], [%[cs]]\n\t"
+      "1:\n\t"
+      "mov %[ret], xzr\n\t"
+      "ldr %w[bin], [%[cpu]]\n\t"
+      "cmp %[bin], %[ncpus]\n\t"
+      "b.hs 2f\n\t"
+      "madd %[bin], %[bin], %[stride], %[bins]\n\t"
+      "ldr %[tmp], [%[bin]]\n\t"
+      "cbz %[tmp], 2f\n\t"
+      "ldr %[ret], [%[bin], #8]\n\t"
+      "sub %[tmp], %[tmp], #1\n\t"
+      "ldr %[ret], [%[ret], %[tmp], lsl #3]\n\t"
+      // Commit
+      "str %[tmp], [%[bin]]\n\t"
+      "2:\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".inst %c[sig]\n\t"
+      "4:\n\t"
+      "b 6b\n\t"
+      ".popsection\n\t"
+      : [ret] "=&r"(ret), [bin] "=&r"(bin), [tmp] "=&r"(tmp)
+      : [cs] "r"(&Rs->rseq_cs), [cpu] "r"(&Rs->cpu_id), [bins] "r"(Bins),
+        [stride] "r"(Stride), [ncpus] "r"(NumCpus), [sig] "i"(RSEQ_SIG_CODE)
+      : "memory", "cc");
+#endif
+  return ret;
+}
+
+/// \brief Pushes \p Obj onto the CpuBin of the current CPU (see rseqPop()).
+/// Returns false, if the bin already holds \p Capacity objects or the current
+/// CPU is not below \p NumCpus.
+inline bool rseqPush(struct rseq *Rs, char *Bins, size_t Stride,
+                     size_t NumCpus, void *Obj, size_t Capacity) noexcept {
+  uint64_t ok, bin, tmp;
+#if defined(__x86_64__)
+  __asm__ __volatile__(
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      "6:\n\t"
+      "leaq 3b(%%rip), %[tmp]\n\t"
+      "movq %[tmp], (%[cs])\n\t"
+      "1:\n\t"
+      "xorl %k[ok], %k[ok]\n\t"
+      "movl (%[cpu]), %k[bin]\n\t"
+      "cmpq %[ncpus], %[bin]\n\t"
+      "jae 2f\n\t"
+      "imulq %[stride], %[bin]\n\t"
+      "addq %[bins], %[bin]\n\t"
+      "movq (%[bin]), %[tmp]\n\t"
+      "cmpq %[cap], %[tmp]\n\t"
+      "jae 2f\n\t"
+      // The slot above the top is not part of the bin yet
+      "movq 8(%[bin]), %[ok]\n\t"
+      "movq %[obj], (%[ok], %[tmp], 8)\n\t"
+      "incq %[tmp]\n\t"
+      "movl $1, %k[ok]\n\t"
+      // Commit
+      "movq %[tmp], (%[bin])\n\t"
+      "2:\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".long %c[sig]\n\t"
+      "4:\n\t"
+      "jmp 6b\n\t"
+      ".popsection\n\t"
+      : [ok] "=&r"(ok), [bin] "=&r"(bin), [tmp] "=&r"(tmp)
+      : [cs] "r"(&Rs->rseq_cs), [cpu] "r"(&Rs->cpu_id), [bins] "r"(Bins),
+        [stride] "r"(Stride), [ncpus] "r"(NumCpus), [obj] "r"(Obj),
+        [cap] "r"(Capacity), [sig] "i"(RSEQ_SIG)
+      : "memory", "cc");
+#else
+  __asm__ __volatile__(
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      "6:\n\t"
+      "adrp %[tmp], 3b\n\t"
+      "add %[tmp], %[tmp], :lo12:3b\n\t"
+      "str %[tmp], [%[cs]]\n\t"
+      "1:\n\t"
+      "mov %[ok], xzr\n\t"
+      "ldr %w[bin], [%[cpu]]\n\t"
+      "cmp %[bin], %[ncpus]\n\t"
+      "b.hs 2f\n\t"
+      "madd %[bin], %[bin], %[stride], %[bins]\n\t"
+      "ldr %[tmp], [%[bin]]\n\t"
+      "cmp %[tmp], %[cap]\n\t"
+      "b.hs 2f\n\t"
+      // The slot above the top is not part of the bin yet
+      "ldr %[ok], [%[bin], #8]\n\t"
+      "str %[obj], [%[ok], %[tmp], lsl #3]\n\t"
+      "add %[tmp], %[tmp], #1\n\t"
+      "mov %[ok], #1\n\t"
+      // Commit
+      "str %[tmp], [%[bin]]\n\t"
+      "2:\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".inst %c[sig]\n\t"
+      "4:\n\t"
+      "b 6b\n\t"
+      ".popsection\n\t"
+      : [ok] "=&r"(ok), [bin] "=&r"(bin), [tmp] "=&r"(tmp)
+      : [cs] "r"(&Rs->rseq_cs), [cpu] "r"(&Rs->cpu_id), [bins] "r"(Bins),
+        [stride] "r"(Stride), [ncpus] "r"(NumCpus), [obj] "r"(Obj),
+        [cap] "r"(Capacity), [sig] "i"(RSEQ_SIG_CODE)
+      : "memory", "cc");
+#endif
+  return ok != 0;
+}
+#endif
+} // namespace detail
+} // namespace me
\ No newline at end of file
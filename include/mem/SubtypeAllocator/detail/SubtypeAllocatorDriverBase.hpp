@@ -1,7 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <new>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mem/SubtypeAllocator/Lifetime.hpp"
+
 namespace mem {
 namespace detail {
 class SubtypeAllocatorDriverBase {
@@ -25,37 +40,288 @@ protected:
     }
   };
 
-  struct BlockBase {
-    BlockBase *next = nullptr;
+  /// Describes a block of objects. The descriptors are kept in a side table
+  /// (Config::blocks) instead of in front of the objects, such that every
+  /// byte of a block is payload.
+  struct BlockInfo {
+    char *data;
+    /// The number of objects this block has been created for
+    size_t numObjects;
+    /// The number of bytes allocated for this block
+    size_t numBytes;
+    /// The alignment this block has been allocated with
+    size_t alignment;
+  };
+
+  /// Precedes every object that is allocated on its own, see Config::direct
+  struct DirectHeader {
+    DirectHeader *prev;
+    DirectHeader *next;
+  };
+
+  /// The objects of a size-class that have been deallocated by other threads
+  /// than its owner, see SubtypeAllocatorDriver::enableRemoteDeallocation()
+  struct alignas(64) RemoteFreeList {
+    std::atomic<void *> head{nullptr};
+    /// The only thread that allocates and uses the free-list
+    std::thread::id owner = std::this_thread::get_id();
   };
 
   struct Config {
-    BlockBase *root;
+    /// The data of the block that is currently filled, if any
+    char *current;
     void **freeList;
     size_t pos, last;
+    /// True, iff the not yet allocated chunks in [pos, last) of current are
+    /// known to be zero-filled
+    bool zeroed = false;
+    /// True, iff the objects are too large for being pooled. They are
+    /// allocated one by one and returned to the system on deallocation.
+    bool direct = false;
+    /// True, iff the blocks have PoolConfig::uniformBlockBytes bytes and can
+    /// be handed over to other size-classes once they are empty
+    bool uniform = false;
+    /// The lifetime class of the objects, see getId()
+    Lifetime lifetime = Lifetime::Default;
+    /// The number of objects to allocate at once
+    size_t blockSize = 0;
+    /// The live objects, if direct
+    DirectHeader *directObjects = nullptr;
+    /// All blocks of this size-class in allocation order
+    std::vector<BlockInfo> blocks;
+    /// If set, deallocations from other threads than its owner are pushed
+    /// here instead of to the free-list
+    RemoteFreeList *remoteFrees = nullptr;
 
-    Config(BlockBase *Root, void **FreeList, size_t Pos, size_t Last) noexcept
-        : root(Root), freeList(FreeList), pos(Pos), last(Last) {}
+    Config(char *Current, void **FreeList, size_t Pos, size_t Last) noexcept
+        : current(Current), freeList(FreeList), pos(Pos), last(Last) {}
   };
 
   std::vector<TypeInfo> typeInfos;
   std::vector<Config> configs;
+  /// Emptied Config::blocks of a former driver, see Metadata
+  std::vector<std::vector<BlockInfo>> spareBlockLists;
+  /// The storage of Config::remoteFrees; does not move its elements and, in
+  /// contrast to a deque, does not allocate while it is empty
+  std::list<RemoteFreeList> remoteFreeLists;
+  /// The number of bytes currently allocated per AllocationTag. Only tagged
+  /// (de-)allocations are accounted here.
+  std::vector<size_t> tagLiveBytes;
+
+public:
+  /// A snapshot of the memory usage of one size-class, see
+  /// SubtypeAllocatorDriver::getStatistics()
+  struct SizeClassStatistics {
+    size_t objectSize;
+    size_t objectAlignment;
+    /// The number of blocks allocated for this size-class
+    size_t numBlocks;
+    /// The number of objects that fit into these blocks
+    size_t capacity;
+    /// The number of chunks that have ever been handed out. Since the
+    /// free-list is always used first, this is the peak number of live objects
+    size_t numUsed;
+    /// The number of currently allocated objects
+    size_t numLive;
+  };
+
+  /// A callback that is invoked for an object before it is finally released.
+  using ReleaseHook = void (*)(void *Ctx, void *Obj) noexcept;
+
+protected:
+  std::vector<std::pair<ReleaseHook, void *>> releaseHooks;
+
+public:
+  /// \brief The (empty) storage of the bookkeeping of a driver. A BlockCache
+  /// keeps it when a child driver is destroyed and hands it to the next child,
+  /// so children do not allocate their bookkeeping at steady state either.
+  struct Metadata {
+    std::vector<TypeInfo> typeInfos;
+    std::vector<Config> configs;
+    std::vector<std::vector<BlockInfo>> spareBlockLists;
+    std::vector<size_t> tagLiveBytes;
+    std::vector<std::pair<ReleaseHook, void *>> releaseHooks;
+  };
+
+protected:
+  /// Exchanges the bookkeeping of this driver with \p M
+  void swapMetadata(Metadata &M) noexcept {
+    typeInfos.swap(M.typeInfos);
+    configs.swap(M.configs);
+    spareBlockLists.swap(M.spareBlockLists);
+    tagLiveBytes.swap(M.tagLiveBytes);
+    releaseHooks.swap(M.releaseHooks);
+  }
 
 public:
   using UserAllocatorId = size_t;
   static constexpr UserAllocatorId InvalidId = -1;
 
+  /// A small user-defined number that attributes allocations to a subsystem.
+  /// Tags should be kept dense, since the driver keeps one counter for each tag
+  /// up to the largest one used.
+  using AllocationTag = size_t;
+
+  /// The upper bits of an Id stored in a refc control-block may carry the
+  /// (1-based) index of a ReleaseHook; the lower bits are the actual Id.
+  static constexpr unsigned ReleaseHookShift = 48;
+  static constexpr UserAllocatorId IdMask =
+      (UserAllocatorId(1) << ReleaseHookShift) - 1;
+
   inline void deallocate(void *Obj, UserAllocatorId Id) noexcept {
     // std::cerr << "deallocate(" << Id << ")\n";
-    auto freeList = configs[Id].freeList;
+    auto &config = configs[Id];
+    if (__builtin_expect(config.direct || config.remoteFrees, false)) {
+      if (config.remoteFrees &&
+          config.remoteFrees->owner != std::this_thread::get_id()) {
+        deallocateRemote(Obj, Id);
+        return;
+      }
+      if (config.direct) {
+        deallocateDirect(Obj, Id);
+        return;
+      }
+    }
+    auto freeList = config.freeList;
     // Obj has at least one pointer-size (See the definition of NormalizedSize
     // in getId())
     auto nwFL = reinterpret_cast<void **>(Obj);
     *nwFL = freeList;
-    configs[Id].freeList = nwFL;
+    config.freeList = nwFL;
+  }
+
+  /// \brief Deallocates an object that has been allocated with the same \p Id
+  /// and \p Tag and updates the accounting of \p Tag.
+  inline void deallocate(void *Obj, UserAllocatorId Id,
+                         AllocationTag Tag) noexcept {
+    tagLiveBytes[Tag] -= typeInfos[Id].objectSize;
+    deallocate(Obj, Id);
   }
 
   size_t getNumIds() const noexcept { return typeInfos.size(); }
+
+  /// Returns the number of bytes allocated for each object with \p Id
+  size_t getObjectSize(UserAllocatorId Id) const noexcept {
+    return typeInfos[Id].objectSize;
+  }
+
+  /// \brief Registers a callback that is run before an object whose Id carries
+  /// the returned hook index is finally released.
+  /// \returns The hook index to store in the upper bits of the Id (shifted by
+  /// ReleaseHookShift). It is never 0.
+  size_t registerReleaseHook(ReleaseHook Hook, void *Ctx) {
+    releaseHooks.emplace_back(Hook, Ctx);
+    return releaseHooks.size();
+  }
+
+  /// \brief For internal use only.
+  ///
+  /// Runs the release-hook with the (1-based) index \p HookIdx on \p Obj.
+  void runReleaseHook(size_t HookIdx, void *Obj) noexcept {
+    auto [hook, ctx] = releaseHooks[HookIdx - 1];
+    hook(ctx, Obj);
+  }
+
+  /// \brief Returns the number of tags that have been used for allocations
+  /// with this driver so far, i.e. the largest tag plus one.
+  size_t getNumTags() const noexcept { return tagLiveBytes.size(); }
+
+  /// \brief Returns the number of bytes currently allocated with \p Tag. The
+  /// size of each object is accounted with its normalized size.
+  size_t getLiveBytes(AllocationTag Tag) const noexcept {
+    return Tag < tagLiveBytes.size() ? tagLiveBytes[Tag] : 0;
+  }
+
+protected:
+  /// Returns the offset of an object from the start of its direct allocation
+  static constexpr size_t directOffset(size_t ObjectAlignment) noexcept {
+    return std::max(sizeof(DirectHeader), ObjectAlignment);
+  }
+
+  static DirectHeader *directHeader(void *Obj) noexcept {
+    return reinterpret_cast<DirectHeader *>(Obj) - 1;
+  }
+
+  static size_t systemPageSize() noexcept {
+    static const size_t pageSize = ::sysconf(_SC_PAGESIZE);
+    return pageSize;
+  }
+
+  /// Returns the number of bytes mapped for a direct object of \p Id
+  size_t directMappingBytes(UserAllocatorId Id) const noexcept {
+    const auto [osize, oalign] = typeInfos[Id];
+    const auto page = systemPageSize();
+    return (directOffset(oalign) + osize + page - 1) & ~(page - 1);
+  }
+
+  /// Allocates an object with \p Id on its own and links it into the
+  /// directObjects of its Config. The memory is mapped with mmap (and is
+  /// therefore already zeroed), so that freeDirect() reliably returns it to
+  /// the OS, independent of malloc's dynamic mmap threshold.
+  void *allocateDirect(UserAllocatorId Id) {
+    const auto oalign = typeInfos[Id].objectAlignment;
+    const auto numBytes = directMappingBytes(Id);
+    const auto page = systemPageSize();
+
+    // Mappings are page-aligned; for larger alignments, map more and trim
+    const auto slack = oalign > page ? oalign - page : 0;
+    auto *raw = static_cast<char *>(::mmap(nullptr, numBytes + slack,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED)
+      throw std::bad_alloc();
+
+    auto *mem = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(raw) + oalign - 1) & ~(oalign - 1));
+    if (slack) {
+      if (mem != raw)
+        ::munmap(raw, mem - raw);
+      if (const size_t tail = raw + slack - mem)
+        ::munmap(mem + numBytes, tail);
+    }
+
+    auto *ret = mem + directOffset(oalign);
+    auto &config = configs[Id];
+    auto *hdr = directHeader(ret);
+    hdr->prev = nullptr;
+    hdr->next = config.directObjects;
+    if (config.directObjects)
+      config.directObjects->prev = hdr;
+    config.directObjects = hdr;
+
+    return ret;
+  }
+
+  /// Unmaps the memory of an object without unlinking it
+  void freeDirect(void *Obj, UserAllocatorId Id) noexcept {
+    const auto oalign = typeInfos[Id].objectAlignment;
+    auto *mem = static_cast<char *>(Obj) - directOffset(oalign);
+    ::munmap(mem, directMappingBytes(Id));
+  }
+
+  void deallocateDirect(void *Obj, UserAllocatorId Id) noexcept {
+    auto &config = configs[Id];
+    auto *hdr = directHeader(Obj);
+    if (hdr->prev)
+      hdr->prev->next = hdr->next;
+    else
+      config.directObjects = hdr->next;
+    if (hdr->next)
+      hdr->next->prev = hdr->prev;
+
+    freeDirect(Obj, Id);
+  }
+
+  /// Pushes \p Obj to the RemoteFreeList of \p Id. Lock-free and safe to call
+  /// from any thread.
+  void deallocateRemote(void *Obj, UserAllocatorId Id) noexcept {
+    auto &head = configs[Id].remoteFrees->head;
+    auto *old = head.load(std::memory_order_relaxed);
+    do {
+      *static_cast<void **>(Obj) = old;
+    } while (!head.compare_exchange_weak(old, Obj, std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
 };
 } // namespace detail
 } // namespace mem
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "mem/SubtypeAllocator/refc.hpp"
+
+namespace mem {
+namespace detail {
+/// \brief The header at the start of every slab of an OutOfLineRefcFactory.
+///
+/// Slabs are aligned to their size, so the slab (and the slot) of an object
+/// can be derived from its address. The reference-counters of the slots live
+/// in a separate, dense array. The header is written only when the slab is
+/// created.
+struct ool_slab {
+  /// The size (and alignment) of each slab
+  static constexpr size_t SlabBytes = size_t(1) << 16;
+
+  /// Destroys the object in a slot whose counter has dropped to \c 0 and
+  /// makes the slot available again
+  using ReleaseFn = void (*)(void *Owner, void *Obj) noexcept;
+
+  std::atomic_size_t *counters;
+  size_t dataOffset;
+  size_t chunkSize;
+  ReleaseFn release;
+  void *owner;
+  ool_slab *next;
+
+  static ool_slab *of(const void *Obj) noexcept {
+    return reinterpret_cast<ool_slab *>(reinterpret_cast<uintptr_t>(Obj) &
+                                        ~(SlabBytes - 1));
+  }
+
+  std::atomic_size_t &counterOf(const void *Obj) const noexcept {
+    const auto offset = reinterpret_cast<const char *>(Obj) -
+                        reinterpret_cast<const char *>(this) - dataOffset;
+    return counters[offset / chunkSize];
+  }
+};
+} // namespace detail
+
+/// \brief A reference-counted smart-pointer like refc, but the
+/// reference-counters are stored out-of-line in a dense array apart from the
+/// pooled objects. Objects are created with an OutOfLineRefcFactory.
+///
+/// Copying and destroying an ool_refc writes the counter array only and
+/// merely reads the object's slab header. This keeps the pages of an object
+/// graph that has been built before \c fork() shared between the processes,
+/// as long as the children only traverse it. Releasing an object still
+/// writes to its page.
+///
+/// The same restrictions regarding multiple inheritance as for refc apply.
+/// \tparam T The type (or a base type of) the object where this
+/// smart-pointer points to
+template <typename T> class ool_refc final {
+  template <typename> friend class ool_refc;
+
+  T *Ptr = nullptr;
+
+  void retain() const noexcept {
+    detail::ool_slab::of(Ptr)->counterOf(Ptr).fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+public:
+  ool_refc() noexcept = default;
+  ool_refc(std::nullptr_t) noexcept {}
+
+  /// \brief For internal use only.
+  ///
+  /// Adopts the object \p Obj that has been created by an
+  /// OutOfLineRefcFactory with a reference-counter of \c 1.
+  ool_refc(detail::preallocated_t, T *Obj) noexcept : Ptr(Obj) {}
+
+  /// Copy constructor. Increments the reference-counter by one.
+  ool_refc(const ool_refc &Other) noexcept : Ptr(Other.Ptr) {
+    if (Ptr)
+      retain();
+  }
+
+  /// Polymorphic copy constructor. Increments the reference-counter by one.
+  template <typename U, typename = std::enable_if_t<std::is_base_of_v<T, U>>>
+  ool_refc(const ool_refc<U> &Other) noexcept : Ptr(Other.Ptr) {
+    if (Ptr)
+      retain();
+  }
+
+  /// Move constructor. Does not touch the reference-counter. Leaves \p Other
+  /// in \c nullptr state.
+  ool_refc(ool_refc &&Other) noexcept : Ptr(Other.Ptr) { Other.Ptr = nullptr; }
+
+  /// Polymorphic move constructor. Does not touch the reference-counter.
+  /// Leaves \p Other in \c nullptr state.
+  template <typename U, typename = std::enable_if_t<std::is_base_of_v<T, U>>>
+  ool_refc(ool_refc<U> &&Other) noexcept : Ptr(Other.Ptr) {
+    Other.Ptr = nullptr;
+  }
+
+  /// Destructor. Decrements the reference-counter by one. If it reaches \c 0,
+  /// destroys the object and gives its slot back to the factory.
+  ~ool_refc() {
+    if (!Ptr)
+      return;
+
+    auto *slab = detail::ool_slab::of(Ptr);
+    // Release, such that the accesses of all other owners happen before the
+    // object is destroyed by the last one, which acquires them
+    if (slab->counterOf(Ptr).fetch_sub(1, std::memory_order_release) == 1) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      slab->release(slab->owner, const_cast<std::remove_cv_t<T> *>(Ptr));
+    }
+    Ptr = nullptr;
+  }
+
+  /// Assignment operator for copy- and move-assignment. Releases the
+  /// previously held object (if any) after taking over \p Other.
+  ool_refc &operator=(ool_refc Other) noexcept {
+    std::swap(Ptr, Other.Ptr);
+    return *this;
+  }
+
+  /// \brief Returns the number of ool_refc smart-pointers that currently share
+  /// the pointee, or \c 0 in \c nullptr state.
+  size_t use_count() const noexcept {
+    return Ptr ? detail::ool_slab::of(Ptr)->counterOf(Ptr).load(
+                     std::memory_order_acquire)
+               : 0;
+  }
+
+  /// \brief Checks whether this is the only ool_refc pointing to its pointee.
+  bool unique() const noexcept { return use_count() == 1; }
+
+  inline T *get() const noexcept { return Ptr; }
+  inline T *operator->() const noexcept { return Ptr; }
+  inline T &operator*() const noexcept { return *Ptr; }
+
+  explicit operator bool() const noexcept { return Ptr != nullptr; }
+
+  bool operator==(std::nullptr_t) const noexcept { return !Ptr; }
+  bool operator!=(std::nullptr_t) const noexcept { return Ptr != nullptr; }
+
+  /// Checks pointer-equality with the Other ool_refc smart pointer
+  template <typename U>
+  bool operator==(const ool_refc<U> &Other) const noexcept {
+    return Ptr == Other.Ptr;
+  }
+  /// Checks pointer-inequality with the Other ool_refc smart pointer
+  template <typename U>
+  bool operator!=(const ool_refc<U> &Other) const noexcept {
+    return !(*this == Other);
+  }
+};
+} // namespace mem
\ No newline at end of file
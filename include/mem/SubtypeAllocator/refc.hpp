@@ -3,32 +3,66 @@
 #include <atomic>
 #include <cassert>
 #include <type_traits>
+#include <utility>
 
 #ifdef HAVE_LLVM
 #include "llvm/ADT/DenseMapInfo.h"
 #include "llvm/Support/Hashing.h"
 #endif
 
+#include "mem/Probes.hpp"
 #include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
 #include "mem/SubtypeAllocator/detail/SubtypeAllocatorDriverBase.hpp"
 
 namespace mem {
 
 template <typename T> class enable_refc_from_this;
+template <typename T> class refc;
+template <typename T> class unique_refc;
+class RelocationTable;
+
+template <typename T> void discard(refc<T> &Rc) noexcept;
 
 namespace detail {
+template <typename T, typename Hash, typename KeyEqual> class InternTable;
+
+/// The control-block that precedes every object managed by refc
+struct refc_counter {
+  static constexpr unsigned ReleaseHookShift =
+      detail::SubtypeAllocatorDriverBase::ReleaseHookShift;
+  static constexpr size_t IdMask = detail::SubtypeAllocatorDriverBase::IdMask;
+  /// If set in Ctr, the object is immortal: It is never released and refcs
+  /// pointing to it do not touch Ctr anymore.
+  static constexpr size_t ImmortalBit = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+  std::atomic_size_t Ctr;
+  size_t Id;
+  detail::SubtypeAllocatorDriverBase *Del;
+
+  refc_counter(size_t Ctr, size_t Id,
+               detail::SubtypeAllocatorDriverBase *Del) noexcept
+      : Ctr(Ctr), Id(Id), Del(Del) {}
+  /// For an object owned by a unique_refc: Ctr is 0 until the object is
+  /// shared with a refc. Code that inspects all allocated objects (e.g.
+  /// clone_all() or isImmortal()) therefore reads a defined value.
+  refc_counter(size_t Id, detail::SubtypeAllocatorDriverBase *Del) noexcept
+      : Ctr(0), Id(Id), Del(Del) {}
+
+  /// Once set, the ImmortalBit is never cleared, so a relaxed load suffices
+  bool isImmortal() const noexcept {
+    return Ctr.load(std::memory_order_relaxed) & ImmortalBit;
+  }
+
+  /// Increments Ctr, unless the object is immortal
+  void retain() noexcept {
+    if (!isImmortal())
+      Ctr.fetch_add(1, std::memory_order_relaxed);
+  }
+};
 
 class refc_base {
 protected:
-  struct counter {
-    std::atomic_size_t Ctr;
-    size_t Id;
-    detail::SubtypeAllocatorDriverBase *Del;
-
-    counter(size_t Ctr, size_t Id,
-            detail::SubtypeAllocatorDriverBase *Del) noexcept
-        : Ctr(Ctr), Id(Id), Del(Del) {}
-  };
+  using counter = refc_counter;
 
   counter *Data = nullptr;
 
@@ -36,6 +70,19 @@ protected:
   explicit refc_base(const refc_base &Other) noexcept : Data(Other.Data) {}
 };
 
+/// Tag type for constructing a refc in memory that has already been allocated.
+struct preallocated_t {
+  explicit preallocated_t() = default;
+};
+inline constexpr preallocated_t preallocated{};
+
+/// Tag type for constructing a refc in memory that is known to be
+/// zero-filled.
+struct zero_initialized_t {
+  explicit zero_initialized_t() = default;
+};
+inline constexpr zero_initialized_t zero_initialized{};
+
 } // namespace detail
 
 /// \brief A reference-counted smart-pointer, similar to \c std::shared_ptr, but
@@ -61,7 +108,8 @@ public:
   ///
   /// Objects of this type can neither be copied, nor moved. The intended usage
   /// is to store them in a static variable and only work with them via a refc
-  /// view.
+  /// view. Singletons are immortal, so copying and destroying refcs to them
+  /// does not touch the reference-counter.
   class singleton : one_allocation {
 
     friend class refc<T>;
@@ -72,7 +120,8 @@ public:
     template <typename... Args>
     singleton(Args &&... args) noexcept(
         std::is_nothrow_constructible_v<T, Args...>)
-        : one_allocation(1, detail::SubtypeAllocatorDriverBase::InvalidId,
+        : one_allocation(counter::ImmortalBit,
+                         detail::SubtypeAllocatorDriverBase::InvalidId,
                          nullptr) {
       new (&this->Data) T(std::forward<Args>(args)...);
     }
@@ -85,7 +134,7 @@ private:
   explicit refc(one_allocation *Data, std::true_type increase_counter) noexcept
       : refc_base(Data) {
     if (Data) {
-      Data->Ctr.fetch_add(1, std::memory_order_relaxed);
+      Data->retain();
     }
   }
 
@@ -107,29 +156,45 @@ public:
   refc(SubtypeAllocatorDriver<AllocBlockSize> *Del,
        detail::SubtypeAllocatorDriverBase::UserAllocatorId Id, Args &&... args)
       : refc_base(nullptr) {
-    auto mem = reinterpret_cast<one_allocation *>(Del->allocate(Id));
-    auto Ptr = &mem->Data;
-
-    auto Ctr = static_cast<counter *>(mem);
-    new (Ctr) counter(1, Id, Del);
-
-    try {
+    emplace(Del->allocate(Id), Del, Id, [&](void *Ptr) {
       new (Ptr) T(std::forward<Args>(args)...);
-    } catch (...) {
-      Del->deallocate(mem, Id);
-      // Ptr = nullptr;
-      // Ctr = nullptr;
-      throw;
-    }
+    });
+  }
 
-    Data = mem;
+  /// \brief For internal use only.
+  ///
+  /// Same as above, but uses the memory \p Mem that has already been allocated
+  /// from \p Del with \p Id.
+  template <typename... Args>
+  refc(detail::preallocated_t, void *Mem,
+       detail::SubtypeAllocatorDriverBase *Del,
+       detail::SubtypeAllocatorDriverBase::UserAllocatorId Id, Args &&... args)
+      : refc_base(nullptr) {
+    emplace(Mem, Del, Id,
+            [&](void *Ptr) { new (Ptr) T(std::forward<Args>(args)...); });
+  }
+
+  /// \brief For internal use only.
+  ///
+  /// Creates a value-initialized object in the zero-filled memory \p Mem that
+  /// has been allocated from \p Del with \p Id. Since \p T is trivially
+  /// default-constructible, default-initializing it in zeroed memory yields the
+  /// same object as value-initialization, but without clearing it again.
+  refc(detail::zero_initialized_t, void *Mem,
+       detail::SubtypeAllocatorDriverBase *Del,
+       detail::SubtypeAllocatorDriverBase::UserAllocatorId Id) noexcept
+      : refc_base(nullptr) {
+    static_assert(std::is_trivially_default_constructible_v<T>,
+                  "Only trivially default-constructible types can be "
+                  "value-initialized by zeroing");
+    emplace(Mem, Del, Id, [](void *Ptr) { new (Ptr) T; });
   }
 
   /// Copy constructor. Increments the reference-counter by one.
   refc(const refc &Other) noexcept : refc_base(Other.Data) {
     if (Data) {
-      assert(Other.Data->Del);
-      Data->Ctr.fetch_add(1, std::memory_order_relaxed);
+      assert(Data->Del || Data->isImmortal());
+      Data->retain();
     }
   }
 
@@ -141,11 +206,21 @@ public:
       // Unfortunately cannot reinterpret_cast inside a constexpr
       assert(static_cast<T *>(reinterpret_cast<U *>(MagicPointer)) ==
              reinterpret_cast<T *>(MagicPointer));
-      assert(Data->Del);
-      Data->Ctr.fetch_add(1, std::memory_order_relaxed);
+      assert(Data->Del || Data->isImmortal());
+      Data->retain();
     }
   }
 
+  /// \brief Shares the object owned by \p Other in O(1): Initializes its
+  /// reference-counter to one, which has not been touched while the object
+  /// was owned uniquely. Leaves \p Other in \c nullptr state.
+  template <typename U, typename = std::enable_if_t<std::is_same_v<T, U> ||
+                                                    std::is_base_of_v<T, U>>>
+  refc(unique_refc<U> &&Other) noexcept : refc_base(Other.release()) {
+    if (Data)
+      Data->Ctr.store(1, std::memory_order_relaxed);
+  }
+
   /// Move constructor. Does not touch the reference-counter. Leaves \p Other in
   /// \c nullptr state.
   refc(refc &&Other) noexcept : refc_base(Other.Data) { Other.Data = nullptr; }
@@ -158,13 +233,13 @@ public:
     assert(!Data || static_cast<T *>(reinterpret_cast<U *>(MagicPointer)) ==
                         reinterpret_cast<T *>(MagicPointer));
 
-    assert(!Data || Data->Del);
+    assert(!Data || Data->Del || Data->isImmortal());
     Other.Data = nullptr;
   }
 
   /// Destructor. Decrements the reference-counter by one. If it reaches \c 0,
   /// uses the stored SubtypeAllocatorDriver to deallocate the object woth
-  /// control-block.
+  /// control-block. Does nothing for immortal objects.
   /// Leaves this object in \c nullptr state
   ~refc() {
     if (!*this)
@@ -173,20 +248,72 @@ public:
     auto dat = static_cast<one_allocation *>(Data);
     Data = nullptr;
 
-    auto oldUseCount = dat->Ctr.fetch_sub(1, std::memory_order_relaxed);
+    if (__builtin_expect(dat->isImmortal(), false))
+      return;
+
+    // Release, such that the accesses of all other owners happen before the
+    // object is destroyed by the last one, which acquires them. An acquire
+    // load instead of a fence, since ThreadSanitizer does not model fences.
+    auto oldUseCount = dat->Ctr.fetch_sub(1, std::memory_order_release);
     if (oldUseCount == 1 && dat->Del) {
+      (void)dat->Ctr.load(std::memory_order_acquire);
+      auto id = dat->Id;
+      MEM_PROBE2(refc_release, dat, id);
+      if (__builtin_expect(id > counter::IdMask, false)) {
+        dat->Del->runReleaseHook(id >> counter::ReleaseHookShift, dat);
+        id &= counter::IdMask;
+      }
+
       auto *dataPtr = reinterpret_cast<T *>(&dat->Data);
       try {
         dataPtr->~T();
       } catch (...) {
-        dat->Del->deallocate(dat, dat->Id);
+        dat->Del->deallocate(dat, id);
         throw;
       }
 
-      dat->Del->deallocate(dat, dat->Id);
+      dat->Del->deallocate(dat, id);
     }
   }
 
+  /// Assignment operator for copy- and move-assignment. Releases the
+  /// previously held object (if any) after taking over \p Other.
+  refc &operator=(refc Other) noexcept {
+    std::swap(Data, Other.Data);
+    return *this;
+  }
+
+  /// \brief Returns the number of refc smart-pointers that currently share
+  /// the pointee, or \c 0 in \c nullptr state. Immortal objects (e.g.
+  /// singletons) are not counted and report a use-count of at least \c
+  /// counter::ImmortalBit.
+  size_t use_count() const noexcept {
+    return *this ? Data->Ctr.load(std::memory_order_acquire) : 0;
+  }
+
+  /// \brief Makes the pointee immortal, e.g. a hot shared object that will not
+  /// be modified anymore: From now on, copying and destroying refcs to it
+  /// does not touch its reference-counter and it is never released.
+  ///
+  /// The memory of an immortal object that has been created by a RefcFactory is
+  /// freed together with the factory, but its destructor is not called.
+  void make_immortal() const noexcept {
+    if (*this)
+      Data->Ctr.fetch_or(counter::ImmortalBit, std::memory_order_relaxed);
+  }
+
+  /// Checks whether the pointee is immortal, see make_immortal()
+  bool is_immortal() const noexcept { return *this && Data->isImmortal(); }
+
+  /// \brief Checks whether a callback runs when the pointee is released, e.g.
+  /// because it is interned. Such objects must not be modified in place.
+  bool has_release_hook() const noexcept {
+    return *this && Data->Id > counter::IdMask;
+  }
+
+  /// \brief Checks whether this is the only refc pointing to its pointee.
+  bool unique() const noexcept { return use_count() == 1; }
+
   inline T *get() noexcept {
     return reinterpret_cast<T *>(&static_cast<one_allocation *>(Data)->Data);
   }
@@ -203,11 +330,14 @@ public:
 
   /// Same as *this != nullptr && *this != getEmptyKey() && *this !=
   /// getTombstoneKey()
-  operator bool() const noexcept { return size_t(Data + 2) < 3; }
+  operator bool() const noexcept {
+    // nullptr, -1 and -2 are mapped to 2, 0 and 1 respectively
+    return reinterpret_cast<size_t>(Data) + 2 > 2;
+  }
 
   /// Checks whether this smart-pointer is in the \c nullptr state which means
   /// the pointee cannot be accessed.
-  bool operator==(std::nullptr_t) const noexcept { return Data; }
+  bool operator==(std::nullptr_t) const noexcept { return !Data; }
 
   /// Checks pointer-equality with the Other refc smart pointer.
   /// Fails at compile-time, if \p T and \p U are not in the same inheritance
@@ -239,6 +369,31 @@ public:
 
 private:
   friend class enable_refc_from_this<T>;
+  friend class RelocationTable;
+  template <typename, typename, typename> friend class detail::InternTable;
+  friend void discard<T>(refc &Rc) noexcept;
+
+  /// Initializes the control-block in \p Mem and constructs the object with
+  /// \p Construct. Deallocates \p Mem, if the construction throws.
+  template <typename Init>
+  void emplace(void *Mem, detail::SubtypeAllocatorDriverBase *Del,
+               detail::SubtypeAllocatorDriverBase::UserAllocatorId Id,
+               Init &&Construct) {
+    auto mem = reinterpret_cast<one_allocation *>(Mem);
+    auto Ptr = &mem->Data;
+
+    auto Ctr = static_cast<counter *>(mem);
+    new (Ctr) counter(1, Id, Del);
+
+    try {
+      Construct(Ptr);
+    } catch (...) {
+      Del->deallocate(mem, Id);
+      throw;
+    }
+
+    Data = mem;
+  }
 #ifdef HAVE_LLVM
   friend class llvm::DenseMapInfo<refc<T>>;
 #endif
@@ -271,6 +426,11 @@ private:
   }
 };
 
+/// \brief Puts \p Rc into \c nullptr state without releasing its pointee,
+/// e.g. for the roots of an object graph that is going to be dropped as a
+/// whole with RefcFactory::abandon().
+template <typename T> void discard(refc<T> &Rc) noexcept { Rc.Data = nullptr; }
+
 template <typename T> class enable_refc_from_this {
 
 public:
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "mem/SubtypeAllocator/SubtypeAllocator.hpp"
+#include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+#include "mem/SubtypeAllocator/refc.hpp"
+
+namespace mem {
+
+namespace detail {
+/// The deleter of a std::shared_ptr created by to_shared_ptr(). Keeps the
+/// pointee alive by holding one refc reference to it.
+template <typename T> struct refc_deleter {
+  refc<T> Rc;
+
+  void operator()(T *) noexcept { Rc = nullptr; }
+};
+} // namespace detail
+
+/// \brief Shares the object managed by \p Rc with APIs that require a \c
+/// std::shared_ptr, without copying it.
+///
+/// The returned \c std::shared_ptr points to the same object and holds one
+/// reference to it as long as any of its copies is alive. Its control block
+/// is allocated from \p Driver, which should be the driver (e.g. of the
+/// RefcFactory) that owns the object; see RefcFactory::to_shared_ptr().
+/// \returns A \c std::shared_ptr to the pointee of \p Rc, or an empty one, if
+/// \p Rc is in \c nullptr state
+template <typename T, size_t AllocationBlockSize>
+std::shared_ptr<T>
+to_shared_ptr(refc<T> Rc, SubtypeAllocatorDriver<AllocationBlockSize> &Driver) {
+  if (!Rc)
+    return nullptr;
+
+  auto *ptr = Rc.get();
+  return std::shared_ptr<T>(ptr, detail::refc_deleter<T>{std::move(Rc)},
+                            SubtypeAllocator<T, AllocationBlockSize>(&Driver));
+}
+
+/// \brief The reverse of to_shared_ptr(): Returns a new refc to the object
+/// that \p Ptr points to.
+///
+/// A refc needs its reference-counter right in front of the object, so this
+/// only works for \c std::shared_ptrs that have been created by
+/// to_shared_ptr() (or their aliases with the same pointer). Other objects
+/// would have to be copied.
+/// \returns The refc, or a refc in \c nullptr state, if \p Ptr does not share
+/// a refc-managed object
+template <typename T> refc<T> to_refc(const std::shared_ptr<T> &Ptr) noexcept {
+  auto *deleter = std::get_deleter<detail::refc_deleter<T>>(Ptr);
+  if (!deleter || deleter->Rc.get() != Ptr.get())
+    return nullptr;
+  return deleter->Rc;
+}
+
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "mem/SubtypeAllocator/refc.hpp"
+
+namespace mem {
+
+/// \brief A move-only smart-pointer that uniquely owns an object created by
+/// RefcFactory::create_unique(), similar to \c std::unique_ptr.
+///
+/// The object is laid out like the ones managed by refc (see
+/// refc::one_allocation), but its reference-counter is neither initialized
+/// nor touched while it is owned uniquely: Creating, moving and destroying a
+/// unique_refc does not perform any atomic operation. Converting it into a
+/// refc (by moving it) initializes the counter in O(1) and shares the object
+/// from then on.
+///
+/// Do not call enable_refc_from_this::refc_from_this() on a uniquely owned
+/// object. The same restrictions regarding multiple inheritance as for refc
+/// apply.
+/// \tparam T The type (or a base type of) the object where this
+/// smart-pointer points to
+template <typename T> class unique_refc final {
+  template <typename> friend class unique_refc;
+  template <typename> friend class refc;
+
+  using counter = detail::refc_counter;
+  using one_allocation = typename refc<T>::one_allocation;
+
+  counter *Data = nullptr;
+
+  /// Gives up the ownership without destroying the object
+  counter *release() noexcept {
+    auto *ret = Data;
+    Data = nullptr;
+    return ret;
+  }
+
+public:
+  unique_refc() noexcept = default;
+  unique_refc(std::nullptr_t) noexcept {}
+
+  /// \brief For internal use only.
+  ///
+  /// Constructs the object in the memory \p Mem that has been allocated from
+  /// \p Del with \p Id and forwards \p args to the constructor of \p T.
+  /// Deallocates \p Mem, if the construction throws.
+  template <typename... Args>
+  unique_refc(detail::preallocated_t, void *Mem,
+              detail::SubtypeAllocatorDriverBase *Del,
+              detail::SubtypeAllocatorDriverBase::UserAllocatorId Id,
+              Args &&... args) {
+    auto *mem = static_cast<one_allocation *>(Mem);
+    new (static_cast<counter *>(mem)) counter(Id, Del);
+    try {
+      new (&mem->Data) T(std::forward<Args>(args)...);
+    } catch (...) {
+      Del->deallocate(mem, Id);
+      throw;
+    }
+    Data = mem;
+  }
+
+  unique_refc(const unique_refc &) = delete;
+
+  /// Move constructor. Leaves \p Other in \c nullptr state.
+  unique_refc(unique_refc &&Other) noexcept : Data(Other.release()) {}
+
+  /// Polymorphic move constructor. Leaves \p Other in \c nullptr state.
+  template <typename U, typename = std::enable_if_t<std::is_base_of_v<T, U>>>
+  unique_refc(unique_refc<U> &&Other) noexcept : Data(Other.release()) {}
+
+  /// Destructor. Destroys the object and gives its memory back to the
+  /// SubtypeAllocatorDriver it has been allocated from. Like every destructor,
+  /// it is \c noexcept, so \p T's destructor must not throw.
+  ~unique_refc() {
+    if (!Data)
+      return;
+
+    auto *dat = static_cast<one_allocation *>(release());
+    reinterpret_cast<T *>(&dat->Data)->~T();
+    dat->Del->deallocate(dat, dat->Id);
+  }
+
+  /// Move-assignment operator. Destroys the previously owned object (if any)
+  /// after taking over \p Other.
+  unique_refc &operator=(unique_refc Other) noexcept {
+    std::swap(Data, Other.Data);
+    return *this;
+  }
+
+  inline T *get() const noexcept {
+    return Data ? reinterpret_cast<T *>(
+                      &static_cast<one_allocation *>(Data)->Data)
+                : nullptr;
+  }
+  inline T *operator->() const noexcept { return get(); }
+  inline T &operator*() const noexcept { return *get(); }
+
+  explicit operator bool() const noexcept { return Data != nullptr; }
+
+  bool operator==(std::nullptr_t) const noexcept { return !Data; }
+  bool operator!=(std::nullptr_t) const noexcept { return Data != nullptr; }
+};
+} // namespace mem
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "mem/BlockSizeAdvisor.hpp"
+#include "mem/SubtypeAllocator/SubtypeAllocatorDriver.hpp"
+
+int main() {
+  mem::SubtypeAllocatorDriver<64> Driver;
+  auto intId = Driver.getId<int>();
+  auto dblId = Driver.getId<double>();
+
+  // Record a profile: at most 100 ints and 3 doubles are alive at once
+  std::vector<void *> ints, dbls;
+  mem::ProfileRecorder intRecorder;
+  for (int i = 0; i < 100; ++i) {
+    ints.push_back(Driver.allocate(intId));
+    intRecorder.allocated();
+  }
+  for (int i = 0; i < 50; ++i) {
+    Driver.deallocate(ints.back(), intId);
+    ints.pop_back();
+    intRecorder.deallocated();
+  }
+  for (int i = 0; i < 20; ++i) {
+    ints.push_back(Driver.allocate(intId));
+    intRecorder.allocated();
+  }
+  for (int i = 0; i < 3; ++i)
+    dbls.push_back(Driver.allocate(dblId));
+
+  auto stats = Driver.getStatistics();
+  assert(stats.size() == 2);
+  assert(stats[intId].numUsed == 100 && stats[intId].numLive == 70);
+  assert(stats[intId].numBlocks == 2 && stats[intId].capacity == 128);
+  assert(stats[dblId].numUsed == 3 && stats[dblId].numLive == 3);
+
+  auto profiles = mem::profileFromStatistics(stats);
+  assert(profiles[intId].peakObjects ==
+         intRecorder.profile("int", sizeof(int)).peakObjects);
+
+  // Round-trip through the CSV format
+  std::stringstream csv;
+  mem::writeProfile(csv, profiles);
+  auto readBack = mem::readProfile(csv);
+  assert(readBack.size() == 2);
+  assert(readBack[dblId].name == "Id1" && readBack[dblId].peakObjects == 3);
+
+  // Malformed lines are reported instead of skipped
+  std::stringstream bad("# comment\nint,4,10\nlong,8,many\n");
+  try {
+    mem::readProfile(bad);
+    assert(false);
+  } catch (const std::invalid_argument &e) {
+    assert(std::string(e.what()) == "Malformed profile line 3: long,8,many");
+  }
+
+  // With expensive allocations, the block size covering the peak wins
+  auto recs = mem::recommendBlockSizes(profiles, {16, 64, 128, 1024},
+                                       {/*Block*/ 1000, /*Byte*/ 1});
+  assert(recs[intId].blockSize == 128 && recs[intId].numBlocks == 1);
+  assert(recs[intId].reserve == 100);
+  assert(recs[dblId].blockSize == 16);
+
+  // With free allocations, the smallest block size wastes the least memory
+  recs = mem::recommendBlockSizes(profiles, {16, 64, 128, 1024}, {0, 1});
+  assert(recs[intId].blockSize == 16 && recs[intId].wastedBytes ==
+                                              12 * profiles[intId].objectSize);
+
+  auto shared = mem::recommendSharedBlockSize(profiles, {16, 64, 128, 1024},
+                                              {1000, 1});
+  assert(shared == 128);
+
+  std::stringstream header;
+  mem::writeRecommendationHeader(header, recs, shared);
+  std::cout << header.str();
+  assert(header.str().find("constexpr size_t AllocationBlockSize = 128;") !=
+         std::string::npos);
+  assert(header.str().find("constexpr size_t Id0BlockSize = 16;") !=
+         std::string::npos);
+
+  // Names are turned into identifiers
+  recs[intId].name = "std::pair<int, int>";
+  recs[dblId].name = "1st";
+  header.str("");
+  mem::writeRecommendationHeader(header, recs);
+  assert(header.str().find("constexpr size_t std__pair_int__int_BlockSize") !=
+         std::string::npos);
+  assert(header.str().find("constexpr size_t SizeClass1stBlockSize") !=
+         std::string::npos);
+
+  for (auto *p : ints)
+    Driver.deallocate(p, intId);
+  for (auto *p : dbls)
+    Driver.deallocate(p, dblId);
+}
\ No newline at end of file
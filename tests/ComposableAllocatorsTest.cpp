@@ -0,0 +1,90 @@
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "mem/ComposableAllocators.hpp"
+
+struct Allocation {
+  void *ptr;
+  size_t size;
+  size_t align;
+};
+
+template <typename Alloc>
+void allocateAll(Alloc &A, std::vector<Allocation> &Allocs) {
+  for (size_t size : {1, 8, 24, 64, 65, 100, 512, 513, 4096}) {
+    for (size_t align : {8, 16, 64}) {
+      auto *ptr = A.allocate(size, align);
+      assert(ptr);
+      assert(reinterpret_cast<uintptr_t>(ptr) % align == 0);
+      std::memset(ptr, 0xAB, size);
+      assert(A.owns(ptr));
+      Allocs.push_back({ptr, size, align});
+    }
+  }
+}
+
+template <typename Alloc>
+void deallocateAll(Alloc &A, std::vector<Allocation> &Allocs) {
+  for (auto &alloc : Allocs)
+    A.deallocate(alloc.ptr, alloc.size, alloc.align);
+  Allocs.clear();
+}
+
+int main() {
+  std::vector<Allocation> allocs;
+
+  // Sizes <= 64 go to a slab, <= 512 to a SubtypeAllocatorDriver, everything
+  // else to malloc
+  {
+    mem::Segregator<64, mem::PoolSlab<64, 64>,
+                    mem::Segregator<512, mem::DriverAllocator<>,
+                                    mem::Mallocator>>
+        alloc;
+
+    allocateAll(alloc, allocs);
+
+    auto *small = alloc.allocate(32, 8);
+    assert(alloc.getSmall().owns(small));
+    auto *medium = alloc.allocate(200, 8);
+    assert(!alloc.getSmall().owns(medium));
+    assert(alloc.getLarge().getSmall().owns(medium));
+
+    // The slab reuses deallocated chunks
+    alloc.deallocate(small, 32, 8);
+    assert(alloc.allocate(16, 8) == small);
+    alloc.deallocate(small, 16, 8);
+    alloc.deallocate(medium, 200, 8);
+
+    deallocateAll(alloc, allocs);
+  }
+
+  // Buckets of 64 bytes up to 256 bytes with a fallback for larger sizes
+  {
+    using buckets_t = mem::Bucketizer<mem::DriverAllocator<64>, 0, 256, 64>;
+    mem::FallbackAllocator<buckets_t, mem::Mallocator> alloc;
+    auto &buckets = alloc.getPrimary();
+    static_assert(buckets_t::NumBuckets == 4);
+
+    assert(!buckets.allocate(0, 8));
+    assert(!buckets.allocate(257, 8));
+
+    allocateAll(alloc, allocs);
+
+    auto *p1 = alloc.allocate(64, 8);
+    auto *p2 = alloc.allocate(65, 8);
+    auto *p3 = alloc.allocate(1000, 8);
+    assert(buckets.getBucket(64).owns(p1) && !buckets.getBucket(65).owns(p1));
+    assert(buckets.getBucket(65).owns(p2));
+    assert(!buckets.owns(p3));
+    alloc.deallocate(p1, 64, 8);
+    alloc.deallocate(p2, 65, 8);
+    alloc.deallocate(p3, 1000, 8);
+
+    deallocateAll(alloc, allocs);
+  }
+
+  std::cout << "composed allocators: ok" << std::endl;
+}
\ No newline at end of file
@@ -1,7 +1,32 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <new>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "mem/SubtypeAllocator/SubtypeFactory.hpp"
+#include "mem/SubtypeAllocator/cow.hpp"
+
+// Counts the calls of the global operator new while NumNewCalls is counting
+static bool CountNewCalls = false;
+static size_t NumNewCalls = 0;
+
+void *operator new(size_t Size) {
+  if (CountNewCalls)
+    ++NumNewCalls;
+  if (void *ret = std::malloc(Size ? Size : 1))
+    return ret;
+  throw std::bad_alloc();
+}
+void operator delete(void *Ptr) noexcept { std::free(Ptr); }
+void operator delete(void *Ptr, size_t) noexcept { std::free(Ptr); }
 
 struct DoubleWrapper : public mem::enable_refc_from_this<DoubleWrapper> {
   double value;
@@ -38,6 +63,436 @@ void foo() {
   shared_C->printB();
 }
 
+struct Point {
+  long x, y, z;
+};
+
+void testValueInitialized() {
+  mem::RefcFactory<1024, Point> Factory;
+  {
+    // Comes from a fresh block
+    auto fresh = Factory.create_value_initialized<Point>();
+    assert(fresh->x == 0 && fresh->y == 0 && fresh->z == 0);
+    fresh->x = fresh->y = fresh->z = 42;
+  }
+  // Recycled from the free-list
+  auto recycled = Factory.create_value_initialized<Point>();
+  assert(recycled->x == 0 && recycled->y == 0 && recycled->z == 0);
+  std::cout << "value5:  " << recycled->x << std::endl;
+}
+
+void testCreateNear() {
+  constexpr size_t PageSize =
+      mem::SubtypeAllocatorDriver<1024>::NearPageSize;
+  auto pageOf = [](const void *Ptr) {
+    return reinterpret_cast<uintptr_t>(Ptr) / PageSize;
+  };
+  // allocate_near() compares the page of the hint with the page of a chunk,
+  // which starts with the control-block in front of the object
+  auto chunkPageOf = [&](const Point *Obj) {
+    return pageOf(reinterpret_cast<const char *>(Obj) -
+                  sizeof(mem::refc<Point>::counter));
+  };
+
+  mem::RefcFactory<1024, Point> Factory;
+  auto parent = Factory.create<Point>();
+  std::list<mem::refc<Point>> others;
+  for (size_t i = 0; i < 256; ++i)
+    others.push_back(Factory.create<Point>());
+
+  // Free one chunk in the parent's page and then some chunks in other pages,
+  // such that the latter ones are at the front of the free-list
+  auto nearIt = std::find_if(others.begin(), others.end(), [&](auto &Rc) {
+    return chunkPageOf(Rc.get()) == pageOf(parent.get());
+  });
+  assert(nearIt != others.end());
+  others.erase(nearIt);
+  size_t numFarFreed = 0;
+  for (auto it = others.begin(); it != others.end() && numFarFreed < 8;) {
+    if (chunkPageOf(it->get()) != pageOf(parent.get())) {
+      it = others.erase(it);
+      ++numFarFreed;
+    } else {
+      ++it;
+    }
+  }
+
+  auto child = Factory.create_near<Point>(parent);
+  const bool isNear = chunkPageOf(child.get()) == pageOf(parent.get());
+  assert(isNear);
+  std::cout << "near:    " << isNear << std::endl;
+}
+
+struct Literal {
+  long value;
+
+  Literal(long Value) : value(Value) {}
+  friend bool operator==(const Literal &L1, const Literal &L2) {
+    return L1.value == L2.value;
+  }
+};
+
+namespace std {
+template <> struct hash<Literal> {
+  size_t operator()(const Literal &L) const noexcept {
+    return std::hash<long>()(L.value);
+  }
+};
+} // namespace std
+
+void testIntern() {
+  mem::RefcFactory<1024, Literal> Factory;
+  {
+    auto one = Factory.intern<Literal>(1);
+    auto two = Factory.intern<Literal>(2);
+    auto otherOne = Factory.intern<Literal>(1);
+
+    assert(one == otherOne);
+    assert(one != two);
+    std::cout << "intern:  " << (one == otherOne) << std::endl;
+  }
+
+  // The interned objects are gone, so this reuses the memory of the last one
+  // without interning it
+  auto plainOne = Factory.create<Literal>(1);
+  auto internedOne = Factory.intern<Literal>(1);
+  assert(plainOne != internedOne);
+
+  // Force some rehashing
+  std::list<mem::refc<Literal>> literals;
+  for (long i = 0; i < 100; ++i)
+    literals.push_back(Factory.intern<Literal>(i));
+  for (long i = 0; i < 100; i += 2)
+    literals.pop_front();
+  for (long i = 0; i < 100; ++i)
+    assert(Factory.intern<Literal>(i)->value == i);
+  assert(Factory.intern<Literal>(1) == internedOne);
+}
+
+void testCow() {
+  using Factory_t = mem::RefcFactory<1024, Point>;
+  Factory_t Factory;
+
+  mem::cow<Point, Factory_t> original(Factory, Point{1, 2, 3});
+  auto copy = original;
+  assert(original.get_refc() == copy.get_refc());
+  assert(original.get_refc().use_count() == 2);
+
+  copy.write().x = 42;
+  assert(original.get_refc() != copy.get_refc());
+  assert(original->x == 1 && copy->x == 42);
+  assert(original.unique() && copy.unique());
+
+  // Unique values are modified in place
+  auto *before = copy.get_refc().get();
+  copy.write().y = 43;
+  assert(copy.get_refc() == before);
+
+  // Interned values are cloned even if unique, so the intern table stays
+  // consistent
+  mem::RefcFactory<1024, Literal> LitFactory;
+  mem::cow<Literal, decltype(LitFactory)> lit(LitFactory,
+                                              LitFactory.intern<Literal>(5));
+  assert(lit.unique());
+  const auto *interned = lit.get_refc().get();
+  lit.write().value = 6;
+  assert(lit.get_refc() != interned && lit->value == 6);
+  assert(LitFactory.intern<Literal>(6) != lit.get_refc());
+  assert(LitFactory.intern<Literal>(5)->value == 5);
+  std::cout << "cow:     " << original->x << " " << copy->x << std::endl;
+}
+
+struct TreeNode {
+  long value;
+  mem::refc<TreeNode> left = nullptr, right = nullptr;
+
+  TreeNode(long Value) : value(Value) {}
+};
+
+namespace mem {
+template <> struct is_trivially_relocatable<TreeNode> : std::true_type {};
+template <> struct refc_members<TreeNode> {
+  static constexpr auto value =
+      std::make_tuple(&TreeNode::left, &TreeNode::right);
+};
+} // namespace mem
+
+/// Holds a plain number that may look like an address in the pool
+struct Handle {
+  uintptr_t bits;
+};
+
+template <typename Factory>
+mem::refc<TreeNode> buildTree(Factory &F, long Depth, long &Value) {
+  auto node = F.template create<TreeNode>(Value++);
+  if (Depth) {
+    node->left = buildTree(F, Depth - 1, Value);
+    node->right = buildTree(F, Depth - 1, Value);
+  }
+  return node;
+}
+
+long sumTree(const mem::refc<TreeNode> &Node) {
+  if (!Node)
+    return 0;
+  return Node->value + sumTree(Node->left) + sumTree(Node->right);
+}
+
+void testCloneAll() {
+  using Factory_t = mem::RefcFactory<64, TreeNode, Handle>;
+  Factory_t Factory;
+  long value = 0;
+  auto root = buildTree(Factory, 10, value);
+  const auto bits = reinterpret_cast<uintptr_t>(root.get());
+  auto handle = Factory.create<Handle>(Handle{bits});
+  // Create some holes in the free-list
+  root->left->right = nullptr;
+  const auto sum = sumTree(root);
+
+  mem::RelocationTable relocations;
+  std::unique_ptr<Factory_t> clone = Factory.clone_all(relocations);
+  auto clonedRoot = relocations.relocate(root);
+
+  assert(clonedRoot != root);
+  assert(clonedRoot.unique());
+  assert(clonedRoot->left.unique());
+  assert(sumTree(clonedRoot) == sum);
+  // Only refc members are relocated
+  assert(relocations.relocate(handle)->bits == bits);
+
+  // The clone is independent of the original
+  clonedRoot->left->left->value += 1000;
+  assert(sumTree(clonedRoot) == sum + 1000);
+  assert(sumTree(root) == sum);
+
+  clonedRoot->right = buildTree(*clone, 3, value);
+  std::cout << "clone:   " << sumTree(clonedRoot) << std::endl;
+}
+
+void testAbandon() {
+  using Factory_t = mem::RefcFactory<64, TreeNode, Literal>;
+  Factory_t Factory;
+  long value = 0;
+  auto root = buildTree(Factory, 12, value);
+  auto lit = Factory.intern<Literal>(Literal{7});
+
+  // Drop the whole graph at once instead of releasing node by node
+  mem::discard(root);
+  mem::discard(lit);
+  assert(root == nullptr && lit == nullptr);
+  Factory.abandon();
+
+  // The factory is reusable afterwards
+  auto tree = buildTree(Factory, 3, value);
+  assert(sumTree(tree) != 0);
+  auto lit2 = Factory.intern<Literal>(Literal{7});
+  assert(lit2.unique());
+  std::cout << "abandon: " << sumTree(tree) << std::endl;
+}
+
+void testImmortal() {
+  static mem::refc<int>::singleton empty(0);
+  {
+    mem::refc<int> rc1(empty);
+    auto rc2 = rc1;
+    assert(rc1.is_immortal() && rc2.use_count() == rc1.use_count());
+  }
+  assert(mem::refc<int>(empty).use_count() >=
+         mem::refc<int>::counter::ImmortalBit);
+
+  mem::RefcFactory<64, int> Factory;
+  auto frozen = Factory.create<int>(17);
+  frozen.make_immortal();
+  const auto *ptr = frozen.get();
+  {
+    std::vector<mem::refc<int>> copies(100, frozen);
+    assert(!frozen.unique());
+  }
+  frozen = nullptr;
+  // Not released, although no refc points to it anymore
+  assert(*ptr == 17);
+
+  // Copy-on-write never writes into an immortal object
+  mem::cow<int, decltype(Factory)> value(Factory, 17);
+  value.get_refc().make_immortal();
+  auto shared = value.get_refc();
+  value.write() = 18;
+  assert(*shared == 17 && *value == 18);
+  std::cout << "immortal: " << *shared << std::endl;
+}
+
+void testToSharedPtr() {
+  mem::SubtypeAllocatorDriver<64> Driver;
+  auto id = Driver.getId<mem::refc<Point>::one_allocation>();
+  mem::refc<Point> rc(&Driver, id, Point{3, 4, 0});
+  auto numLive = [&] {
+    size_t ret = 0;
+    for (auto &stats : Driver.getStatistics())
+      ret += stats.numLive;
+    return ret;
+  };
+  assert(numLive() == 1);
+  {
+    std::shared_ptr<Point> sp = mem::to_shared_ptr(rc, Driver);
+    assert(sp.get() == rc.get() && rc.use_count() == 2);
+    // The control block comes from the driver as well
+    assert(numLive() == 2);
+
+    auto copy = sp;
+    assert(rc.use_count() == 2);
+    assert(mem::to_refc(copy) == rc);
+    assert(rc.use_count() == 2);
+    assert(mem::to_refc(std::make_shared<Point>(Point{1, 2, 0})) == nullptr);
+  }
+  assert(rc.unique() && numLive() == 1);
+
+  mem::RefcFactory<64, Point> Factory;
+  auto sp = Factory.to_shared_ptr(Factory.create<Point>(Point{5, 6, 0}));
+  assert(sp->y == 6 && mem::to_refc(sp).use_count() == 2);
+  std::cout << "to_shared_ptr: " << sp->x << std::endl;
+}
+
+struct Settings {
+  int verbosity;
+};
+
+namespace mem {
+template <>
+struct default_lifetime<Settings>
+    : std::integral_constant<Lifetime, Lifetime::Long> {};
+} // namespace mem
+
+void testLifetime() {
+  mem::RefcFactory<64, Point, Settings> Factory;
+  auto cached = Factory.create<Point>(mem::long_lived, Point{1, 2, 0});
+  std::vector<mem::refc<Point>> temps;
+  for (int i = 0; i < 100; ++i)
+    temps.push_back(Factory.create<Point>(Point{i, i, 0}));
+  auto settings = Factory.create<Settings>(Settings{3});
+
+  // Long-lived objects do not share blocks with the temporaries
+  auto isTemp = [&](const Point *P) {
+    return std::any_of(temps.begin(), temps.end(), [&](auto &Tmp) {
+      return std::abs(reinterpret_cast<const char *>(Tmp.get()) -
+                      reinterpret_cast<const char *>(P)) < 64;
+    });
+  };
+  assert(!isTemp(cached.get()));
+  assert(cached->y == 2 && settings->verbosity == 3);
+  std::cout << "lifetime: " << cached->x << std::endl;
+}
+
+struct OolNode {
+  static inline size_t NumDestroyed = 0;
+
+  long value;
+  mem::ool_refc<OolNode> next;
+
+  OolNode(long Value, mem::ool_refc<OolNode> Next)
+      : value(Value), next(std::move(Next)) {}
+  ~OolNode() { ++NumDestroyed; }
+};
+
+void testOutOfLine() {
+  constexpr long NumNodes = 10000;
+  mem::OutOfLineRefcFactory<OolNode, Point> Factory;
+  mem::ool_refc<OolNode> head;
+  std::vector<const OolNode *> nodes;
+  for (long i = 0; i < NumNodes; ++i) {
+    head = Factory.create<OolNode>(i, std::move(head));
+    nodes.push_back(head.get());
+  }
+
+  std::vector<char> snapshot;
+  for (auto *node : nodes) {
+    auto *bytes = reinterpret_cast<const char *>(node);
+    snapshot.insert(snapshot.end(), bytes, bytes + sizeof(OolNode));
+  }
+
+  // Traversing the graph copies the ool_refcs, but does not write the objects
+  long sum = 0;
+  for (auto it = head; it; it = it->next) {
+    assert(it.use_count() == 2);
+    sum += it->value;
+  }
+  assert(sum == NumNodes * (NumNodes - 1) / 2);
+  for (size_t i = 0, pos = 0; i < nodes.size(); ++i, pos += sizeof(OolNode))
+    assert(!std::memcmp(&snapshot[pos], nodes[i], sizeof(OolNode)));
+
+  // The same holds in a forked child, whose traversal therefore does not
+  // copy the pages of the objects
+  auto pid = ::fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    long childSum = 0;
+    for (auto it = head; it; it = it->next)
+      childSum += it->value;
+    bool unchanged = true;
+    for (size_t i = 0, pos = 0; i < nodes.size(); ++i, pos += sizeof(OolNode))
+      unchanged &= !std::memcmp(&snapshot[pos], nodes[i], sizeof(OolNode));
+    ::_exit(childSum == sum && unchanged ? 0 : 1);
+  }
+  int status;
+  ::waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  auto second = head->next;
+  head = nullptr;
+  assert(OolNode::NumDestroyed == 1 && second.unique());
+  second = nullptr;
+  assert(OolNode::NumDestroyed == NumNodes);
+
+  // Released slots are reused
+  auto point = Factory.create<Point>(Point{1, 2, 3});
+  auto reused = Factory.create<OolNode>(42, nullptr);
+  assert(std::find(nodes.begin(), nodes.end(), reused.get()) != nodes.end());
+  assert(point->z == 3);
+  std::cout << "out-of-line: " << sum << std::endl;
+}
+
+void testUnique() {
+  mem::RefcFactory<64, Point, C> Factory;
+  {
+    auto unique = Factory.create_unique<Point>(Point{1, 2, 3});
+    auto moved = std::move(unique);
+    assert(!unique && moved->y == 2);
+  }
+
+  auto unique = Factory.create_unique<Point>(Point{4, 5, 6});
+  const auto *ptr = unique.get();
+  // Promoting to a refc neither moves nor copies the object
+  mem::refc<Point> shared = std::move(unique);
+  assert(unique == nullptr && shared.get() == ptr && shared.unique());
+  auto copy = shared;
+  assert(shared.use_count() == 2);
+
+  mem::unique_refc<A> base = Factory.create_unique<C>();
+  base->printA();
+  mem::refc<A> sharedBase = std::move(base);
+  assert(sharedBase.unique());
+  std::cout << "unique:  " << copy->z << std::endl;
+}
+
+void testChildFactory() {
+  mem::BlockCache Parent;
+  auto handleRequest = [&Parent] {
+    mem::RefcFactory<64, long, double> Factory(Parent);
+    auto l = Factory.create<long>(7);
+    auto d = Factory.create<double>(2.5);
+    assert(*l == 7 && *d == 2.5);
+  };
+
+  // The first child fills the cache of the parent ...
+  handleRequest();
+  // ... from which all further children take their blocks and bookkeeping
+  CountNewCalls = true;
+  for (int i = 0; i < 10; ++i)
+    handleRequest();
+  CountNewCalls = false;
+  assert(NumNewCalls == 0);
+  std::cout << "child:   " << NumNewCalls << " allocations" << std::endl;
+}
+
 int main() {
 
   mem::RefcFactory<1024, int, long long, DoubleWrapper> Factory;
@@ -65,4 +520,16 @@ int main() {
   std::cout << "value4:  " << *shared_static_int << std::endl;
 
   foo();
+  testValueInitialized();
+  testCreateNear();
+  testIntern();
+  testCow();
+  testCloneAll();
+  testAbandon();
+  testImmortal();
+  testToSharedPtr();
+  testLifetime();
+  testOutOfLine();
+  testUnique();
+  testChildFactory();
 }
\ No newline at end of file
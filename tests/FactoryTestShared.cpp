@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
 
 #include "mem/SubtypeAllocator/SubtypeFactory.hpp"
@@ -39,6 +40,25 @@ void foo() {
   shared_B->printB();
 }
 
+void testSwitchable() {
+  ::setenv("MEM_USE_POOL", "0", 1);
+  mem::SwitchableSharedPtrFactory<1024, int> defaultFactory;
+  ::unsetenv("MEM_USE_POOL");
+  mem::SwitchableSharedPtrFactory<1024, int> pooledFactory;
+
+  assert(!defaultFactory.usesPool());
+  assert(pooledFactory.usesPool());
+
+  auto fromDefault = defaultFactory.create<int>(1);
+  auto fromPool = pooledFactory.create<int>(2);
+  assert(*fromDefault == 1 && *fromPool == 2);
+  assert(defaultFactory.getNumDefaultCreations() == 1 &&
+         defaultFactory.getNumPooledCreations() == 0);
+  assert(pooledFactory.getNumDefaultCreations() == 0 &&
+         pooledFactory.getNumPooledCreations() == 1);
+  std::cout << "switch:  " << pooledFactory.usesPool() << std::endl;
+}
+
 int main() {
 
   mem::SharedPtrFactory<1024, int, long long, DoubleWrapper> Factory;
@@ -62,4 +82,5 @@ int main() {
   std::cout << "value3': " << *shared_double_cpy << std::endl;
 
   foo();
+  testSwitchable();
 }
\ No newline at end of file
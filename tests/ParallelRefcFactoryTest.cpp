@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mem/SubtypeAllocator/SubtypeFactory.hpp"
+
+struct Node {
+  long value;
+  mem::refc<Node> next;
+};
+
+int main() {
+  constexpr long NumThreads = 4;
+  constexpr long NumChains = 50;
+  constexpr long ChainLength = 1000;
+  mem::ParallelRefcFactory<64, Node> Factory;
+
+  // Every worker builds its part of the graph in its own shard
+  std::vector<std::vector<mem::refc<Node>>> chains(NumThreads);
+  std::vector<std::thread> workers;
+  for (long t = 0; t < NumThreads; ++t) {
+    workers.emplace_back([&, t] {
+      for (long c = 0; c < NumChains; ++c) {
+        mem::refc<Node> head = nullptr;
+        for (long i = 0; i < ChainLength; ++i)
+          head = Factory.create<Node>(Node{t, std::move(head)});
+        chains[t].push_back(std::move(head));
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  workers.clear();
+  assert(Factory.getNumShards() == NumThreads);
+
+  long sum = 0;
+  for (auto &part : chains) {
+    for (auto &head : part) {
+      for (auto *node = head.get();; node = node->next.get()) {
+        sum += node->value;
+        if (!node->next)
+          break;
+      }
+    }
+  }
+  assert(sum == NumChains * ChainLength * NumThreads * (NumThreads - 1) / 2);
+
+  // Release every part in another thread than the one that has built it
+  for (long t = 0; t < NumThreads; ++t)
+    workers.emplace_back([&, t] { chains[(t + 1) % NumThreads].clear(); });
+  for (auto &worker : workers)
+    worker.join();
+
+  // The remotely released objects are reused by their shard
+  std::vector<mem::unique_refc<Node>> nodes;
+  for (long i = 0; i < 64; ++i)
+    nodes.push_back(Factory.create_unique<Node>(Node{i, nullptr}));
+  std::vector<const Node *> addresses;
+  for (auto &node : nodes)
+    addresses.push_back(node.get());
+  std::thread([&] { nodes.clear(); }).join();
+  for (long i = 0; i < 64; ++i) {
+    nodes.push_back(Factory.create_unique<Node>(Node{i, nullptr}));
+    assert(std::find(addresses.begin(), addresses.end(), nodes.back().get()) !=
+           addresses.end());
+  }
+
+  // Objects released by their creating thread are reused right away
+  const auto *local = Factory.create<Node>(Node{0, nullptr}).get();
+  assert(Factory.create<Node>(Node{1, nullptr}).get() == local);
+
+  // Two threads write different members of a shared object and drop it; the
+  // last one destroys it after seeing both writes
+  for (long i = 0; i < 100; ++i) {
+    auto shared = Factory.create<Node>(Node{0, nullptr});
+    std::thread first([Obj = shared]() mutable {
+      Obj->value = 1;
+      Obj = nullptr;
+    });
+    std::thread second([&Factory, Obj = shared]() mutable {
+      Obj->next = Factory.create<Node>(Node{2, nullptr});
+      Obj = nullptr;
+    });
+    shared = nullptr;
+    first.join();
+    second.join();
+  }
+  std::cout << "parallel: " << sum << std::endl;
+}
\ No newline at end of file
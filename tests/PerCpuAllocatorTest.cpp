@@ -0,0 +1,54 @@
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mem/SubtypeAllocator/PerCpuAllocatorDriver.hpp"
+
+struct Message {
+  long id;
+  char payload[40];
+};
+
+int main() {
+  constexpr size_t CacheCapacity = 32;
+  mem::PerCpuAllocatorDriver<256> Driver(CacheCapacity);
+  const auto id = Driver.getId<Message>();
+#ifdef MEM_HAVE_RSEQ
+  // glibc registers every thread for restartable sequences, unless the kernel
+  // does not support them
+  assert(Driver.usesRseq() == (__rseq_size != 0));
+#else
+  assert(!Driver.usesRseq());
+#endif
+
+  std::vector<std::thread> workers;
+  // Far more threads than CPUs, like a thread-per-connection server
+  for (long t = 0; t < 64; ++t) {
+    workers.emplace_back([&Driver, id, t] {
+      std::vector<Message *> live;
+      for (long round = 0; round < 200; ++round) {
+        for (long i = 0; i < 20; ++i) {
+          auto *msg = static_cast<Message *>(Driver.allocate(id));
+          msg->id = t * 1000 + i;
+          live.push_back(msg);
+        }
+        for (long i = 0; i < 20; ++i)
+          assert(live[i]->id == t * 1000 + i);
+        for (auto *msg : live)
+          Driver.deallocate(msg, id);
+        live.clear();
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  // The parked memory depends on the number of CPUs, not of threads
+  assert(Driver.getNumCached(id) <= Driver.getNumCaches() * CacheCapacity);
+  auto stats = Driver.getDriver().getStatistics();
+  assert(stats[id].numLive == Driver.getNumCached(id));
+  std::cout << "per-cpu: " << Driver.getNumCaches() << " caches, "
+            << Driver.getNumCached(id) << " objects cached, "
+            << (Driver.usesRseq() ? "rseq" : "mutex") << std::endl;
+}
\ No newline at end of file
@@ -1,8 +1,74 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
 #include <list>
+#include <new>
+#include <set>
+#include <stdexcept>
 
 #include "mem/PoolAllocator.hpp"
 
+// PoolAllocator allocates its blocks with aligned array-new
+static size_t NumBlockAllocations = 0;
+
+void *operator new[](size_t Size, std::align_val_t Align) {
+  ++NumBlockAllocations;
+  return std::aligned_alloc(static_cast<size_t>(Align),
+                            (Size + static_cast<size_t>(Align) - 1) &
+                                ~(static_cast<size_t>(Align) - 1));
+}
+void operator delete[](void *Ptr, std::align_val_t) noexcept {
+  std::free(Ptr);
+}
+
+void testReserve() {
+  std::set<int, std::less<int>, mem::PoolAllocator<int>> set;
+  mem::reserve_nodes(set, 5000);
+
+  NumBlockAllocations = 0;
+  for (int i = 0; i < 5000; ++i)
+    set.insert(i);
+  assert(NumBlockAllocations == 1);
+
+  mem::PoolAllocator<int> alloc;
+  alloc.deallocate(alloc.allocate(1), 1);
+  alloc.reserve(3000);
+  NumBlockAllocations = 0;
+  for (int i = 0; i < 3000; ++i)
+    alloc.allocate(1);
+  assert(NumBlockAllocations == 0);
+
+  // Reservations that do not fit into a block are rejected, not truncated
+  try {
+    alloc.reserve(size_t(std::numeric_limits<unsigned>::max()) + 1);
+    assert(false);
+  } catch (const std::length_error &) {
+  }
+  assert(NumBlockAllocations == 0);
+  std::cout << "reserve: " << set.size() << std::endl;
+}
+
+void testOverAligned() {
+  struct alignas(4096) Page {
+    char data[4096];
+  };
+  mem::PoolAllocator<Page, true, 4> alloc;
+
+  // The objects start right at the beginning of the block
+  auto *first = alloc.allocate(1);
+  assert(reinterpret_cast<uintptr_t>(first) % 4096 == 0);
+  for (int i = 1; i < 4; ++i)
+    assert(alloc.allocate(1) == first + i);
+  assert(alloc.owns(first + 3) && !alloc.owns(first + 4));
+  std::cout << "aligned: " << alignof(Page) << std::endl;
+}
+
 int main() {
   std::list<mem::PoolAllocator<int>> pool;
   pool.push_back(4);
+
+  testReserve();
+  testOverAligned();
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+#include "mem/PoolConfig.hpp"
+#include "mem/SubtypeAllocator/SubtypeFactory.hpp"
+
+int main() {
+  setenv("MEM_POOL_BLOCK_SIZE", "16", 1);
+  setenv("MEM_POOL_GROWTH_FACTOR", "2", 1);
+  setenv("MEM_POOL_MAX_BLOCK_BYTES", "0x1000", 1);
+  setenv("MEM_POOL_DIRECT_THRESHOLD", "not a number", 1);
+  setenv("MEM_POOL_PREFAULT", "1", 1);
+  setenv("MEM_POOL_STATS", "off", 1);
+
+  const auto config = mem::PoolConfig::fromEnvironment();
+  assert(config.blockSize == 16 && config.growthFactor == 2);
+  assert(config.maxBlockBytes == 4096);
+  assert(config.directThreshold == mem::PoolConfig{}.directThreshold);
+  assert(config.prefault && !config.printStatistics);
+
+  {
+    mem::SubtypeAllocatorDriver<> Driver(config);
+    auto id = Driver.getId<long>();
+
+    // Blocks of 16, 32, 64, 128, 256 and 512 (= 4096 bytes) objects
+    for (size_t i = 0; i < 1000; ++i)
+      Driver.allocate(id);
+
+    auto stats = Driver.getStatistics()[id];
+    assert(stats.numBlocks == 6 && stats.capacity == 1008);
+    assert(stats.numLive == 1000);
+    Driver.printStatistics(stdout);
+  }
+
+  mem::RefcFactory<1024, long> Factory(config);
+  auto obj = Factory.create<long>(5);
+  assert(*obj == 5);
+  std::cout << "config:  ok" << std::endl;
+}
\ No newline at end of file
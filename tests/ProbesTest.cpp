@@ -0,0 +1,107 @@
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <set>
+#include <string>
+
+#include <elf.h>
+
+#include "mem/PoolAllocator.hpp"
+#include "mem/Probes.hpp"
+#include "mem/SubtypeAllocator/SubtypeFactory.hpp"
+
+/// Returns the names of all USDT probes of \p Provider that are registered in
+/// the \c .note.stapsdt section of the ELF64 image \p Binary.
+static std::set<std::string> readProbes(const std::string &Binary,
+                                        const std::string &Provider) {
+  std::set<std::string> ret;
+  if (Binary.size() < sizeof(Elf64_Ehdr) ||
+      std::memcmp(Binary.data(), ELFMAG, SELFMAG) ||
+      Binary[EI_CLASS] != ELFCLASS64)
+    return ret;
+
+  Elf64_Ehdr ehdr;
+  std::memcpy(&ehdr, Binary.data(), sizeof(ehdr));
+  auto section = [&](size_t Idx) {
+    Elf64_Shdr shdr;
+    std::memcpy(&shdr, Binary.data() + ehdr.e_shoff + Idx * ehdr.e_shentsize,
+                sizeof(shdr));
+    return shdr;
+  };
+  if (ehdr.e_shoff + size_t(ehdr.e_shnum) * ehdr.e_shentsize > Binary.size())
+    return ret;
+
+  const auto strtab = section(ehdr.e_shstrndx);
+  for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+    const auto shdr = section(i);
+    if (shdr.sh_type != SHT_NOTE ||
+        std::strcmp(Binary.data() + strtab.sh_offset + shdr.sh_name,
+                    ".note.stapsdt"))
+      continue;
+
+    // Each note: header, "stapsdt" name, then the descriptor consisting of
+    // the probe's pc, the .stapsdt.base address, the semaphore address and
+    // the strings provider, name and arguments
+    auto align4 = [](size_t N) { return (N + 3) & ~size_t(3); };
+    for (size_t pos = shdr.sh_offset, end = pos + shdr.sh_size;
+         pos + sizeof(Elf64_Nhdr) <= end;) {
+      Elf64_Nhdr nhdr;
+      std::memcpy(&nhdr, Binary.data() + pos, sizeof(nhdr));
+      const char *name = Binary.data() + pos + sizeof(nhdr);
+      const char *desc = name + align4(nhdr.n_namesz);
+      pos += sizeof(nhdr) + align4(nhdr.n_namesz) + align4(nhdr.n_descsz);
+      if (pos > end)
+        break;
+      if (nhdr.n_type != 3 || std::strcmp(name, "stapsdt") ||
+          nhdr.n_descsz <= 3 * sizeof(Elf64_Addr))
+        continue;
+
+      const char *provider = desc + 3 * sizeof(Elf64_Addr);
+      if (Provider == provider)
+        ret.insert(provider + std::strlen(provider) + 1);
+    }
+  }
+  return ret;
+}
+
+int main() {
+  // Instantiate all probed code paths
+  {
+    std::list<int, mem::PoolAllocator<int>> lst;
+    lst.push_back(1);
+
+    mem::RefcFactory<64, long> Factory({100});
+    auto obj = Factory.create<long>(42);
+    assert(*obj == 42);
+  }
+
+#ifndef MEM_HAVE_PROBES
+  std::cout << "probes:  SKIPPED (compiled out: missing <sys/sdt.h> or "
+               "MEM_DISABLE_PROBES defined)"
+            << std::endl;
+  return 0;
+#endif
+
+  std::ifstream ifs("/proc/self/exe", std::ios::binary);
+  assert(ifs && "Cannot read the own binary");
+  const std::string binary((std::istreambuf_iterator<char>(ifs)),
+                           std::istreambuf_iterator<char>());
+
+  const auto probes = readProbes(binary, "mem");
+  int ret = 0;
+  for (auto *probe : {"pool_block_create", "pool_block_destroy",
+                      "driver_block_create", "driver_block_destroy",
+                      "driver_reserve", "driver_new_size_class",
+                      "refc_release"}) {
+    if (!probes.count(probe)) {
+      std::cerr << "Missing probe mem:" << probe << '\n';
+      ret = 1;
+    }
+  }
+  if (!ret)
+    std::cout << "probes:  " << probes.size() << " present" << std::endl;
+  return ret;
+}
\ No newline at end of file
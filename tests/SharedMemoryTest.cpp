@@ -0,0 +1,67 @@
+#include <cassert>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mem/SubtypeAllocator/SharedMemoryDriver.hpp"
+
+struct Node {
+  long value;
+  mem::shm_refc<Node> next;
+
+  Node(long Value, mem::shm_refc<Node> Next = nullptr)
+      : value(Value), next(std::move(Next)) {}
+};
+
+int main() {
+  mem::SharedMemoryDriver Driver(1 << 20);
+  Node *oldSecond;
+  {
+    auto list = Driver.create<Node>(1, Driver.create<Node>(2));
+    oldSecond = list->next.get();
+    Driver.setRoot(list);
+  }
+
+  auto pid = ::fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    // Map the segment a second time, such that it lives at a different
+    // address in this process
+    int ret = 0;
+    {
+      auto Child = mem::SharedMemoryDriver::attach(::dup(Driver.getFd()));
+      auto list = Child.getRoot<Node>();
+      if (!list || list->value != 1 || list->next->value != 2 ||
+          list->next.get() == oldSecond)
+        ret = 1;
+      else
+        // Replace the second node; the old one goes to the shared free-list
+        list->next = Child.create<Node>(3);
+    }
+    ::_exit(ret);
+  }
+
+  int status;
+  ::waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  auto list = Driver.getRoot<Node>();
+  assert(list->value == 1 && list->next->value == 3);
+  std::cout << "shared:  " << list->value << " -> " << list->next->value
+            << std::endl;
+
+  // Reuses the node that has been freed by the child
+  auto reused = Driver.create<Node>(4);
+  assert(reused.get() == oldSecond);
+  assert(list.use_count() == 2);
+
+  // Size-class Ids are cached per type, but each segment has its own
+  mem::SharedMemoryDriver Other(1 << 20);
+  Other.getId<long[8]>();
+  Other.getId<long[16]>();
+  const auto id = Driver.getId<Node>();
+  const auto otherId = Other.getId<Node>();
+  assert(id != otherId);
+  assert(Driver.getId<Node>() == id && Other.getId<Node>() == otherId);
+}
\ No newline at end of file
@@ -1,5 +1,15 @@
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
 
 #include "mem/SubtypeAllocator/SubtypeAllocator.hpp"
 
@@ -16,4 +26,204 @@ int main() {
   auto shared_double = std::allocate_shared<double>(
       mem::SubtypeAllocator<double>(&Driver), 24.42);
   std::cout << "value3: " << *shared_double << std::endl;
+
+  {
+    constexpr mem::SubtypeAllocatorDriver<1024>::AllocationTag ParserTag = 0,
+                                                               CacheTag = 1;
+    std::list<int, mem::TaggedSubtypeAllocator<int>> parserList(
+        mem::TaggedSubtypeAllocator<int>(&Driver, ParserTag));
+    auto cached = std::allocate_shared<double>(
+        mem::TaggedSubtypeAllocator<double>(&Driver, CacheTag), 1.5);
+
+    parserList.push_back(1);
+    parserList.push_back(2);
+
+    assert(Driver.getNumTags() == 2);
+    assert(Driver.getLiveBytes(ParserTag) != 0);
+    assert(Driver.getLiveBytes(CacheTag) != 0);
+    std::cout << "parser:  " << Driver.getLiveBytes(ParserTag) << " bytes\n";
+    std::cout << "cache:   " << Driver.getLiveBytes(CacheTag) << " bytes\n";
+
+    parserList.clear();
+    assert(Driver.getLiveBytes(ParserTag) == 0);
+  }
+  assert(Driver.getLiveBytes(1) == 0);
+
+  {
+    mem::SubtypeAllocatorDriver<1024> CacheDriver;
+    using alloc_t = mem::SubtypeAllocator<std::pair<const int, double>>;
+    std::map<int, double, std::less<int>, alloc_t> cache{alloc_t(&CacheDriver)};
+    for (int i = 0; i < 10000; ++i)
+      cache.emplace(i, i * 0.5);
+
+    // Leave the map empty without visiting its nodes and drop them at once
+    mem::discard(cache);
+    assert(cache.empty());
+    CacheDriver.release();
+
+    cache.emplace(1, 1.5);
+    assert(cache.size() == 1 && cache.at(1) == 1.5);
+    std::cout << "discard: " << cache.size() << std::endl;
+  }
+  {
+    struct Medium {
+      char data[64 << 10];
+    };
+    struct Huge {
+      char data[1 << 20];
+    };
+
+    mem::SubtypeAllocatorDriver<1024> LargeDriver;
+    auto mediumId = LargeDriver.getId<Medium>();
+    auto hugeId = LargeDriver.getId<Huge>();
+
+    // A block is limited to DefaultMaxBlockBytes instead of 1024 objects
+    auto *medium = LargeDriver.allocate(mediumId);
+    auto stats = LargeDriver.getStatistics();
+    assert(stats[mediumId].capacity ==
+           LargeDriver.DefaultMaxBlockBytes / sizeof(Medium));
+
+    // Huge objects are allocated one by one and freed on deallocation
+    auto *huge1 = LargeDriver.allocate(hugeId);
+    auto *huge2 = LargeDriver.allocate_zeroed(hugeId);
+    assert(static_cast<char *>(huge2)[sizeof(Huge) - 1] == 0);
+    assert(LargeDriver.owns(huge1) && LargeDriver.owns(huge2));
+    assert(LargeDriver.getStatistics()[hugeId].numLive == 2);
+
+    // ... and returned to the OS, so their pages are no longer mapped
+    LargeDriver.deallocate(huge1, hugeId);
+    auto *hugePage = reinterpret_cast<void *>(
+        reinterpret_cast<uintptr_t>(huge1) & ~uintptr_t(4095));
+    assert(::msync(hugePage, 4096, MS_ASYNC) == -1 && errno == ENOMEM);
+    stats = LargeDriver.getStatistics();
+    assert(stats[hugeId].numLive == 1 && stats[hugeId].capacity == 1);
+
+    struct alignas(1 << 16) AlignedHuge {
+      char data[1 << 20];
+    };
+    auto alignedId = LargeDriver.getId<AlignedHuge>();
+    auto *aligned = static_cast<AlignedHuge *>(LargeDriver.allocate(alignedId));
+    assert(reinterpret_cast<uintptr_t>(aligned) % alignof(AlignedHuge) == 0);
+    std::memset(aligned, 1, sizeof(AlignedHuge));
+    LargeDriver.deallocate(aligned, alignedId);
+    LargeDriver.deallocate(medium, mediumId);
+    std::cout << "large:   " << stats[mediumId].capacity << " per block\n";
+    // huge2 is freed by the destructor
+  }
+  {
+    mem::SubtypeAllocatorDriver<64> LifetimeDriver;
+    auto shortId = LifetimeDriver.getId<long>();
+    auto longId = LifetimeDriver.getId<long>(mem::Lifetime::Long);
+    assert(shortId != longId && longId == LifetimeDriver.getId<long>(
+                                              mem::Lifetime::Long));
+    assert(LifetimeDriver.getLifetime(longId) == mem::Lifetime::Long);
+
+    auto *config = static_cast<long *>(LifetimeDriver.allocate(longId));
+    *config = 42;
+    for (int i = 0; i < 1000; ++i)
+      LifetimeDriver.allocate(shortId);
+
+    // Drop all temporaries at once, the long-lived object stays valid
+    LifetimeDriver.release(mem::Lifetime::Default);
+    auto stats = LifetimeDriver.getStatistics();
+    assert(stats[shortId].numBlocks == 0 && stats[longId].numLive == 1);
+    assert(*config == 42);
+    std::cout << "lifetime: " << *config << std::endl;
+  }
+  {
+    mem::BlockCache Parent;
+    auto handleRequest = [&Parent](int NumObjects) {
+      mem::SubtypeAllocatorDriver<256> Child(Parent);
+      using alloc_t = mem::SubtypeAllocator<int, 256>;
+      std::list<int, alloc_t> objects{alloc_t(&Child)};
+      for (int i = 0; i < NumObjects; ++i)
+        objects.push_back(i);
+      assert(objects.back() == NumObjects - 1);
+      // The blocks go back to Parent
+    };
+
+    handleRequest(1000);
+    const auto numCached = Parent.getNumCachedBlocks();
+    assert(numCached != 0);
+    // Steady state: The next request only borrows the cached blocks
+    handleRequest(1000);
+    assert(Parent.getNumCachedBlocks() == numCached);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+      workers.emplace_back([&] {
+        for (int i = 0; i < 100; ++i)
+          handleRequest(500);
+      });
+    }
+    for (auto &worker : workers)
+      worker.join();
+    assert(Parent.getNumCachedBlocks() <= 4 * numCached);
+    std::cout << "parent:  " << Parent.getCachedBytes() << " bytes cached\n";
+  }
+  {
+    struct Small {
+      long data[4];
+    };
+    struct Large {
+      long data[8];
+    };
+
+    mem::PoolConfig config;
+    config.uniformBlockBytes = 64 << 10;
+    mem::SubtypeAllocatorDriver<> Driver(config);
+    auto smallId = Driver.getId<Small>();
+    auto largeId = Driver.getId<Large>();
+
+    std::vector<void *> smalls;
+    for (int i = 0; i < 10000; ++i)
+      smalls.push_back(Driver.allocate(smallId));
+    const auto numSmallBlocks = Driver.getStatistics()[smallId].numBlocks;
+    // Keep the first object alive, so its block stays
+    for (size_t i = 1; i < smalls.size(); ++i)
+      Driver.deallocate(smalls[i], smallId);
+
+    // The type mix changes: The empty blocks move to the other size-class
+    assert(Driver.reclaimEmptyBlocks() == numSmallBlocks - 1);
+    assert(Driver.getNumEmptyBlocks() == numSmallBlocks - 1);
+    assert(Driver.getStatistics()[smallId].numBlocks == 1);
+    assert(Driver.owns(smalls.front()) && !Driver.owns(smalls.back()));
+
+    for (int i = 0; i < 4000; ++i)
+      Driver.allocate(largeId);
+    auto stats = Driver.getStatistics();
+    assert(Driver.getNumEmptyBlocks() + stats[largeId].numBlocks ==
+           numSmallBlocks - 1);
+
+    // The surviving block is still usable
+    assert(Driver.allocate(smallId) != smalls[0]);
+    std::cout << "reclaim: " << stats[largeId].numBlocks << " blocks reused\n";
+  }
+  {
+    struct alignas(4096) Page {
+      char data[4096];
+    };
+    struct Odd {
+      char data[24];
+    };
+
+    mem::PoolConfig config;
+    config.blockSize = 1000;
+    config.pageExactBlocks = true;
+    mem::SubtypeAllocatorDriver<> Driver(config);
+    auto pageId = Driver.getId<Page>();
+    auto oddId = Driver.getId<Odd>();
+
+    // No header in front of the objects: The first page holds an object
+    auto *page = static_cast<char *>(Driver.allocate(pageId));
+    assert(reinterpret_cast<uintptr_t>(page) % 4096 == 0);
+    assert(Driver.allocate(pageId) == page + 4096);
+
+    // The block is rounded up to whole pages, and the rest is used for objects
+    Driver.allocate(oddId);
+    auto stats = Driver.getStatistics()[oddId];
+    assert(stats.capacity * sizeof(Odd) % 4096 == 0);
+    assert(stats.capacity * sizeof(Odd) < 1000 * sizeof(Odd) + 4096);
+    std::cout << "pages:   " << stats.capacity << " objects per block\n";
+  }
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+// Reads an allocation profile (CSV lines "name,objectSize,peakObjects", e.g.
+// written by mem::writeProfile()) and generates a header with the recommended
+// block sizes.
+//
+// Usage: BlockSizeAdvisor [profile.csv] [blockCost] [byteCost] > Tuning.hpp
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "mem/BlockSizeAdvisor.hpp"
+
+int main(int argc, char **argv) {
+  std::vector<mem::SizeClassProfile> profiles;
+  try {
+    if (argc > 1) {
+      std::ifstream ifs(argv[1]);
+      if (!ifs) {
+        std::cerr << "Cannot open " << argv[1] << '\n';
+        return 1;
+      }
+      profiles = mem::readProfile(ifs);
+    } else {
+      profiles = mem::readProfile(std::cin);
+    }
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  mem::BlockSizeCostModel model;
+  if (argc > 2)
+    model.costPerBlockAllocation = std::atof(argv[2]);
+  if (argc > 3)
+    model.costPerWastedByte = std::atof(argv[3]);
+
+  const auto candidates = mem::defaultBlockSizeCandidates();
+  auto recs = mem::recommendBlockSizes(profiles, candidates, model);
+  const size_t shared =
+      profiles.empty()
+          ? 0
+          : mem::recommendSharedBlockSize(profiles, candidates, model);
+
+  for (auto &rec : recs)
+    std::cerr << rec.name << ": " << rec.blockSize << " objects/block, "
+              << rec.numBlocks << " blocks, " << rec.wastedBytes
+              << " wasted bytes\n";
+
+  mem::writeRecommendationHeader(std::cout, recs, shared);
+}
\ No newline at end of file